@@ -0,0 +1,170 @@
+#ifndef __AVLBALANCER_H_
+#define __AVLBALANCER_H_
+
+/**
+ * AVL树的旋转和平衡逻辑，与结点的存储方式无关
+ * Derived通过CRTP提供对结点的访问，Link是指向结点的链接(指针或数组下标)
+ * 1. Link &leftOf(Link x) / Link &rightOf(Link x): 左右子结点的链接
+ * 2. bool isNull(Link x): 是否为空链接
+ * 3. int getNodeHeight(Link x): 结点的高度，空链接为0
+ * 4. void updateNode(Link x): 由左右子树重新计算x的高度和附加信息
+ * 所有函数都是constexpr，Derived的访问函数也是constexpr时可以在常量表达式中使用
+ */
+template <class Derived, class Link>
+class AVLBalancer {
+protected:
+    constexpr Link rebalance(Link x);
+
+    constexpr Link LL(Link root);
+    constexpr Link LR(Link root);
+    constexpr Link RL(Link root);
+    constexpr Link RR(Link root);
+
+    constexpr Link leftRotate(Link root);
+    constexpr Link rightRotate(Link root);
+
+private:
+    constexpr Derived &derived() { return static_cast<Derived &>(*this); }
+};
+
+/**
+ * 新加入的结点在左子树的左子树上，导致左子树偏高
+ *               O(root, x+3, diff=2)
+ *       O(x+2)        O(x)
+ *   O(x+1)   O(x)
+ */
+template <class Derived, class Link>
+constexpr Link AVLBalancer<Derived, Link>::LL(Link root)
+{
+    return rightRotate(root);
+}
+
+/**
+ * 新加入的结点在左子树的右子树上，导致左子树偏高
+ *              O(root, x+3, diff = 2)
+ *        O(x+2)          O(x)
+ *   O(x)     O(x+1)
+ */
+template <class Derived, class Link>
+constexpr Link AVLBalancer<Derived, Link>::LR(Link root)
+{
+    derived().leftOf(root) = leftRotate(derived().leftOf(root));
+    return LL(root);
+}
+
+/**
+ * 新加入的结点在右子树的右子树上，导致右子树偏高
+ *               O(root, x+3, diff=2)
+ *       O(x)          O(x+2)
+ *                 O(x)   O(x+1)
+ */
+template <class Derived, class Link>
+constexpr Link AVLBalancer<Derived, Link>::RR(Link root)
+{
+    return leftRotate(root);
+}
+
+/**
+ * 新加入的结点在右子树的左子树上，导致右子树偏高
+ *               O(root, x+3, diff=2)
+ *       O(x)          O(x+2)
+ *                 O(x+1)   O(x)
+ */
+template <class Derived, class Link>
+constexpr Link AVLBalancer<Derived, Link>::RL(Link root)
+{
+    derived().rightOf(root) = rightRotate(derived().rightOf(root));
+    return RR(root);
+}
+
+/**
+ * 按照root为根结点，进行左旋
+ *   O(root)                     O(newRoot)
+ *       O           ==>  O(oldRoot)     O
+ *           O
+ */
+template <class Derived, class Link>
+constexpr Link AVLBalancer<Derived, Link>::leftRotate(Link root)
+{
+    Derived &d = derived();
+    if (d.isNull(root) || d.isNull(d.rightOf(root))) {
+        return root;
+    }
+
+    Link oldRoot = root;
+    Link newRoot = d.rightOf(root);
+
+    d.rightOf(oldRoot) = d.leftOf(newRoot);
+    d.leftOf(newRoot) = oldRoot;
+
+    d.updateNode(oldRoot);
+    d.updateNode(newRoot);
+
+    return newRoot;
+}
+
+/**
+ * 按照root为根结点，进行右旋
+ *              O(root)             O(newRoot)
+ *         O            ==>    O         O(oldRoot)
+ *    O
+ */
+template <class Derived, class Link>
+constexpr Link AVLBalancer<Derived, Link>::rightRotate(Link root)
+{
+    Derived &d = derived();
+    if (d.isNull(root) || d.isNull(d.leftOf(root))) {
+        return root;
+    }
+
+    Link oldRoot = root;
+    Link newRoot = d.leftOf(root);
+
+    d.leftOf(oldRoot) = d.rightOf(newRoot);
+    d.rightOf(newRoot) = oldRoot;
+
+    d.updateNode(oldRoot);
+    d.updateNode(newRoot);
+
+    return newRoot;
+}
+
+/**
+ * 左右子树的高度差超过1时旋转，否则只更新x；
+ * 偏高一侧的子结点两棵子树等高时(只在删除后出现)必须用单旋转
+ */
+template <class Derived, class Link>
+constexpr Link AVLBalancer<Derived, Link>::rebalance(Link x)
+{
+    Derived &d = derived();
+    if (d.isNull(x)) {
+        return x;
+    }
+
+    Link leftNode = d.leftOf(x);
+    Link rightNode = d.rightOf(x);
+    Link newRoot = x; // default
+
+    int leftHight = d.getNodeHeight(leftNode);
+    int rightHight = d.getNodeHeight(rightNode);
+
+    if (leftHight - rightHight > 1) {
+        if (d.getNodeHeight(d.leftOf(leftNode)) >= d.getNodeHeight(d.rightOf(leftNode))) {
+            newRoot = LL(x);
+        } else {
+            newRoot = LR(x);
+        }
+    } else if (leftHight - rightHight < -1) {
+        if (d.getNodeHeight(d.rightOf(rightNode)) >= d.getNodeHeight(d.leftOf(rightNode))) {
+            newRoot = RR(x);
+        } else {
+            newRoot = RL(x);
+        }
+    } else {
+        d.updateNode(newRoot);
+    }
+
+    return newRoot;
+}
+
+#endif
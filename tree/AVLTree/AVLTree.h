@@ -3,6 +3,16 @@
 #include <cassert>
 #include <iostream>
 #include <algorithm>
+#include <utility>
+#include <vector>
+#include <memory>
+#include <type_traits>
+#include "../tree_filter.h"
+#include "../tree_cache.h"
+#include "../tree_memory.h"
+#include "../tree_alloc.h"
+#include "../tree_parallel.h"
+#include "AVLBalancer.h"
 using namespace std;
 
 /**
@@ -11,27 +21,47 @@ using namespace std;
  * 2. 带有平衡条件，每个结点的左右子树的高度之差的绝对值最多为1
  * 3. 平衡因子 = |左子树长度 - 右子树长度|
  */
-template <class Key, class Value>
-struct AVLTreeNode {
+/**
+ * 结点附加信息的默认策略：不附加任何信息
+ * 自定义策略需要提供
+ * 1. struct metadata: 保存在每个结点中的附加信息，结点会继承它
+ * 2. static void update(Node *x): 在x的左右子树已经更新的前提下，重新计算x的附加信息
+ * 旋转、插入、删除改变了结点的子树之后都会调用update，因此附加信息始终与子树一致
+ */
+struct AVLNullNodeUpdate {
+    struct metadata {};
+
+    template <class Node>
+    static void update(Node *) {}
+};
+
+/**
+ * OutOfLine为true时值保存在树的ValueArena中，结点只保存对它的引用
+ */
+template <class Key, class Value, class NodeUpdate = AVLNullNodeUpdate, bool OutOfLine = false>
+struct AVLTreeNode : public NodeUpdate::metadata, public NodeValue<Value, OutOfLine> {
     Key key;
-    Value value;
     AVLTreeNode *left;
     AVLTreeNode *right;
     int height;
 
-    AVLTreeNode(const Key &key, const Value &value) {
+    AVLTreeNode(const Key &key, const Value &value, ValueArena<Value> &values)
+        : NodeValue<Value, OutOfLine>(value, values) {
         this->key = key;
-        this->value = value;
         this->height = 1;
         this->left = nullptr;
         this->right = nullptr;
     }
 };
 
-template <class Key, class Value>
-class AVLTree {
+/**
+ * ValueLayout决定值保存在结点内还是结点外，默认按sizeof(Value)自动选择，见tree_alloc.h
+ */
+template <class Key, class Value, class NodeUpdate = AVLNullNodeUpdate, class ValueLayout = AutoValueLayout<>>
+class AVLTree : private AVLBalancer<AVLTree<Key, Value, NodeUpdate, ValueLayout>,
+                                    AVLTreeNode<Key, Value, NodeUpdate, ValueLayout::template outOfLine<Value>()> *> {
 public:
-    using MyAVLTreeNode = AVLTreeNode<Key, Value>;
+    using MyAVLTreeNode = AVLTreeNode<Key, Value, NodeUpdate, ValueLayout::template outOfLine<Value>()>;
     
     AVLTree();
     ~AVLTree();
@@ -42,91 +72,408 @@ public:
     bool isEmpty() { return count_ == 0; }
     bool contain(const Key &key) { return get(key) != nullptr; }
 
-    Value *get(const Key &key) { return get(root_, key); }
-    void put(const Key &key, const Value &val) { root_ = put(root_, key, val); }
+    Value *get(const Key &key) {
+        if (filter_ != nullptr && !filter_->mayContain(key)) {
+            return nullptr;
+        }
+        if (cache_ != nullptr) {
+            return cachedGet(key);
+        }
+        return get(root_, key);
+    }
+    /* 返回值在结点中的地址，直到该键被删除或调用shrink()之前保持不变 */
+    Value *put(const Key &key, const Value &val) {
+        Value *slot = nullptr;
+        root_ = put(root_, key, val, slot);
+        afterInsert();
+        return slot;
+    }
+
+    /**
+     * 批量查找，out[i]为keys[i]对应的值，不存在时为nullptr
+     * 每组同时推进多个查找，每轮每个查找下降一层并预取下一层的结点，
+     * 多个查找的缓存缺失互相重叠；会经过过滤器，但不读写热点缓存
+     */
+    void multiGet(const vector<Key> &keys, vector<Value *> &out);
+
+    /**
+     * 读-改-写只下降一次：fn(value, existed)在结点中原地修改值，
+     * 键不存在时value为Value()，fn返回false时删除该键(不存在时不插入)
+     * 只有插入或删除了结点才重新平衡，返回调用后键是否存在
+     */
+    template <class Func>
+    bool compute(const Key &key, Func fn);
+
+    /* 键不存在时先插入Value()，再原地调用fn(value)，例如计数器加1 */
+    template <class Func>
+    void upsert(const Key &key, Func fn) {
+        compute(key, [&fn](Value &value, bool) { fn(value); return true; });
+    }
 
+    /* 最小、最大的结点被缓存，不需要沿左右边界下降 */
     Key minimum() {
         assert(count_ != 0);
-        const MyAVLTreeNode *minNode = minimum(root_);
-        return minNode->key;
+        return minNode_->key;
     }
     Key maximum() {
         assert(count_ != 0);
-        const MyAVLTreeNode *maxNode = maximum(root_);
-        return maxNode->key;
+        return maxNode_->key;
     }
 
+    /* 小于等于key的最大的键，不存在时返回false */
+    bool floor(const Key &key, Key &result);
+
+    /* 大于等于key的最小的键，不存在时返回false */
+    bool ceiling(const Key &key, Key &result);
+
+    /**
+     * 离key最近的k个键值对，按距离从近到远输出到out(先清空)，距离相同时较小的键在前
+     * 从key的位置同时向前驱和后继两个方向展开，两条路径保存在固定大小的栈上，不分配内存；
+     * 距离用key的减法计算，要求Key是算术类型
+     */
+    void kNearest(const Key &key, int k, vector<pair<Key, Value *>> &out);
+
+    /**
+     * 批量floor：sortedKeys必须升序，out[i]为sortedKeys[i]的floor键和值，不存在时值为nullptr
+     * 保留上一次查找的路径，下一个键只需从仍然可能包含结果的最深的祖先处继续下降
+     */
+    void floorMany(const vector<Key> &sortedKeys, vector<pair<Key, Value *>> &out);
+
     void deleteMin() {
         if (root_ != nullptr)
-            root_ = deleteMin(root_);
+            freeNode(detachMin());
     }
     void deleteMax() {
         if (root_ != nullptr)
-            root_ = deleteMax(root_);
+            freeNode(detachMax());
     }
 
+    /* 删除并返回最小、最大的键值对，作为优先队列使用 */
+    pair<Key, Value> popMin();
+    pair<Key, Value> popMax();
+
+    /* 按升序删除并返回最小的k个键值对 */
+    vector<pair<Key, Value>> popMin(int k);
+
     void deleteKey(const Key &key) { root_ = deleteKey(root_, key); }
 
+    /**
+     * 删除[lo, hi]之间的所有键，返回删除的个数
+     * 按lo和hi把树分裂成三棵，释放中间一棵，再把两边连接起来，
+     * 分裂和连接只沿两条路径调整，复杂度为O(k + log n)，k为删除的个数
+     */
+    int deleteRange(const Key &lo, const Key &hi);
+
+    /**
+     * 删除所有结点，不使用递归
+     * 键和值的析构函数平凡时结点从内存池中按块分配，清空只需释放各个块
+     */
+    void clear();
+
+    /* 开启后clear和析构把释放结点的工作交给后台线程，调用者不等待 */
+    void setDeferredDestruction(bool deferred) {
+        if (deferred) {
+            TreeReclaimer::instance();  // 开启时就启动回收线程，析构时不必再创建
+        }
+        deferred_ = deferred;
+    }
+
+    /**
+     * 用[first, last)中按键严格升序的键值对线性时间建树，原有的键值对全部删除
+     * 每次取中间的元素作为根，得到的树是完全平衡的；过滤器按新的大小重建
+     */
+    template <class Iter>
+    void buildSorted(Iter first, Iter last);
+
     void preOrder() { preOrder(root_); }
     void inOrder() { inOrder(root_); }
     void postOrder() { postOrder(root_); }
 
+    /* 按键的升序访问[lo, hi]之间的所有键值对，fn(key, value) */
+    template <class Func>
+    void forEach(const Key &lo, const Key &hi, Func fn) { forEach(root_, lo, hi, fn); }
+
+    /**
+     * 按子树拆分到工作窃取线程池上，并行访问[lo, hi]之间的所有键值对，fn(key, value)
+     * fn会在多个线程中同时调用，顺序不确定；遍历期间不能修改树
+     */
+    template <class Func>
+    void parallelForEach(const Key &lo, const Key &hi, Func fn) {
+        parallelForEach(root_, lo, hi, fn, WorkStealingPool::instance());
+    }
+
+    /**
+     * 并行归约：对[lo, hi]之间的每个键值对求map(key, value)，再用combine两两合并
+     * 结果总是按键的顺序合并，combine只需满足结合律，不必满足交换律；init必须是combine的单位元
+     */
+    template <class T, class Map, class Combine>
+    T parallelReduce(const Key &lo, const Key &hi, const T &init, Map map, Combine combine) {
+        return parallelReduce(root_, lo, hi, init, map, combine, WorkStealingPool::instance());
+    }
+
+    /**
+     * 在get/contain之前挂一个计数布隆过滤器，大部分不存在的键不需要访问结点
+     * 过滤器随put/deleteKey/popMin等同步更新，键的数量超过容量的2倍时自动按当前大小重建
+     */
+    template <class Hash = hash<Key>>
+    void enableFilter(int expectedKeys, double fpRate = 0.01);
+    void disableFilter() { filter_.reset(); }
+
+    /* 按max(容量, size())重新生成过滤器，批量修改之后调用 */
+    void rebuildFilter();
+
+    /* 结点、分配器开销和附加结构占用的内存，O(1) */
+    TreeMemoryUsage memoryUsage();
+
+    /* put使占用超出limit字节时调用onExceeded，limit为0表示不设预算 */
+    void setMemoryBudget(size_t limit, TreeMemoryBudget::Callback onExceeded) { budget_.set(limit, onExceeded); }
+
+    /**
+     * 大量删除之后调用：按当前大小重建过滤器，并把分配器中空闲的内存还给操作系统
+     * 内存池或ValueArena中不到一半在使用时，把结点和值搬到新的池和区域中再释放旧的，
+     * 之前get/put返回的值的指针随之失效
+     */
+    void shrink();
+
+    /**
+     * 在get前面挂一个slots个槽的直接映射缓存，反复读取的热点键只需一次哈希探测
+     * 结点被删除时同步失效；get会修改缓存，挂了缓存后不能由多个线程同时读
+     */
+    template <class Hash = hash<Key>>
+    void enableCache(int slots);
+    void disableCache() { cache_.reset(); }
+
+    uint64_t cacheHits() { return cache_ != nullptr ? cache_->hits() : 0; }
+    uint64_t cacheMisses() { return cache_ != nullptr ? cache_->misses() : 0; }
+
 private:
-    MyAVLTreeNode *put(MyAVLTreeNode *root, const Key &key, const Value &val);
+    MyAVLTreeNode *put(MyAVLTreeNode *root, const Key &key, const Value &val, Value *&slot);
     Value *get(MyAVLTreeNode *root, const Key &key);
 
-    MyAVLTreeNode *deleteMin(MyAVLTreeNode *x);
-    MyAVLTreeNode *deleteMax(MyAVLTreeNode *x);
+    MyAVLTreeNode *detachMin();
+    MyAVLTreeNode *detachMax();
+    MyAVLTreeNode *detachMin(MyAVLTreeNode *x, MyAVLTreeNode *&minNode, MyAVLTreeNode *&newMin);
+    MyAVLTreeNode *detachMax(MyAVLTreeNode *x, MyAVLTreeNode *&maxNode, MyAVLTreeNode *&newMax);
 
     MyAVLTreeNode *deleteKey(MyAVLTreeNode *x, const Key &key);
 
+    static const int kMaxHeight = 64;  // 键的个数不超过2^31时AVL树的高度小于64
+
+    void split(MyAVLTreeNode *x, const Key &key, bool inclusive, MyAVLTreeNode *&left, MyAVLTreeNode *&right);
+    MyAVLTreeNode *join(MyAVLTreeNode *left, MyAVLTreeNode *mid, MyAVLTreeNode *right);
+    MyAVLTreeNode *join(MyAVLTreeNode *left, MyAVLTreeNode *right);
+    int releaseRange(MyAVLTreeNode *x);
+
+    template <class Func>
+    MyAVLTreeNode *compute(MyAVLTreeNode *x, const Key &key, Func &fn, bool &changed, bool &exists);
+
+    template <class Iter>
+    MyAVLTreeNode *buildSorted(Iter first, int n);
+
+    MyAVLTreeNode *createNode(const Key &key, const Value &val);
+    MyAVLTreeNode *unlinkNode(MyAVLTreeNode *x);
+    void afterInsert();
+
     const MyAVLTreeNode *minimum(const MyAVLTreeNode *x);
     const MyAVLTreeNode *maximum(const MyAVLTreeNode *x);
 
-    void destroy(MyAVLTreeNode *node);
+    static const bool kPooled = is_trivially_destructible<MyAVLTreeNode>::value;
+    static const bool kOutOfLine = ValueLayout::template outOfLine<Value>();
+
+    MyAVLTreeNode *allocNode(const Key &key, const Value &val);
+    void freeNode(MyAVLTreeNode *node);
+    void releaseNodes(MyAVLTreeNode *root);
+    static void destroy(MyAVLTreeNode *node);
+    MyAVLTreeNode *relocate(MyAVLTreeNode *x, NodePool<MyAVLTreeNode> &pool, ValueArena<Value> &values);
+    void resetFilter(size_t capacity);
+    void fillFilter(MyAVLTreeNode *node);
+
+    Value *cachedGet(const Key &key);
+
+    /* 结点即将从树中移除，同步过滤器和缓存 */
+    void forgetNode(const MyAVLTreeNode *x);
 
     void preOrder(MyAVLTreeNode *node);
     void inOrder(MyAVLTreeNode *node);
     void postOrder(MyAVLTreeNode *node);
 
-private:
-    MyAVLTreeNode *rebalance(MyAVLTreeNode *x);                                                                                                                                                                                                    getNodeHeight(MyAVLTreeNode *x) { return x != nullptr ? x->height : 0; }
+    template <class Func>
+    void forEach(MyAVLTreeNode *x, const Key &lo, const Key &hi, Func &fn);
 
-    MyAVLTreeNode *LL(MyAVLTreeNode *root);
-    MyAVLTreeNode *LR(MyAVLTreeNode *root);
-    MyAVLTreeNode *RL(MyAVLTreeNode *root);
-    MyAVLTreeNode *RR(MyAVLTreeNode *root);
+    static const int kSerialHeight = 12;  // 不超过这个高度的子树在当前线程中串行处理
 
-    MyAVLTreeNode *leftRotate(MyAVLTreeNode *root);
-    MyAVLTreeNode *rightRotate(MyAVLTreeNode *root);
+    template <class Func>
+    void parallelForEach(MyAVLTreeNode *x, const Key &lo, const Key &hi, Func &fn, WorkStealingPool &pool);
+
+    template <class T, class Map, class Combine>
+    T parallelReduce(MyAVLTreeNode *x, const Key &lo, const Key &hi, const T &init,
+                     Map &map, Combine &combine, WorkStealingPool &pool);
 
 private:
+    using Balancer = AVLBalancer<AVLTree<Key, Value, NodeUpdate, ValueLayout>, MyAVLTreeNode *>;
+    friend Balancer;
+    using Balancer::rebalance;
+
+    /* 供AVLBalancer访问结点 */
+    MyAVLTreeNode *&leftOf(MyAVLTreeNode *x) { return x->left; }
+    MyAVLTreeNode *&rightOf(MyAVLTreeNode *x) { return x->right; }
+    bool isNull(MyAVLTreeNode *x) { return x == nullptr; }
+    int getNodeHeight(MyAVLTreeNode *x) { return x != nullptr ? x->height : 0; }
+
+    static void prefetch(const void *p) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(p);
+#endif
+    }
+    void updateNode(MyAVLTreeNode *x);
+
+protected:
     MyAVLTreeNode *root_;
+    MyAVLTreeNode *minNode_;
+    MyAVLTreeNode *maxNode_;
     int count_;
+    unique_ptr<CountingBloomFilter<Key>> filter_;
+    unique_ptr<NodeCache<Key, MyAVLTreeNode>> cache_;
+    TreeMemoryBudget budget_;
+    NodePool<MyAVLTreeNode> pool_;
+    ValueArena<Value> values_;
+    bool deferred_;
 };
 
-template <class Key, class Value>
-AVLTree<Key, Value>::AVLTree()
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::AVLTree()
+{
+    root_ = nullptr;
+    minNode_ = nullptr;
+    maxNode_ = nullptr;
+    count_ = 0;
+    deferred_ = false;
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::~AVLTree()
+{
+    clear();
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::clear()
 {
+    MyAVLTreeNode *root = root_;
+
     root_ = nullptr;
+    minNode_ = nullptr;
+    maxNode_ = nullptr;
     count_ = 0;
+    if (filter_ != nullptr) {
+        filter_->clear();
+    }
+    if (cache_ != nullptr) {
+        cache_->clear();
+    }
+
+    releaseNodes(root);
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+template <class Iter>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::buildSorted(Iter first, Iter last)
+{
+    clear();
+    root_ = buildSorted(first, static_cast<int>(last - first));
+    if (filter_ != nullptr) {
+        rebuildFilter();
+    }
+    if (budget_.enabled()) {
+        budget_.check(memoryUsage());
+    }
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+template <class Iter>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::buildSorted(Iter first, int n)
+{
+    if (n == 0) {
+        return nullptr;
+    }
+
+    int mid = n / 2;
+    MyAVLTreeNode *left = buildSorted(first, mid);
+    MyAVLTreeNode *x = createNode(first[mid].first, first[mid].second);
+    x->left = left;
+    x->right = buildSorted(first + mid + 1, n - mid - 1);
+    updateNode(x);
+    return x;
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::allocNode(const Key &key, const Value &val)
+{
+    if (kPooled) {
+        return new (pool_.allocate()) MyAVLTreeNode(key, val, values_);
+    }
+    return new MyAVLTreeNode(key, val, values_);
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::freeNode(MyAVLTreeNode *x)
+{
+    x->releaseValue(values_);
+    if (kPooled) {
+        pool_.deallocate(x);
+    } else {
+        delete x;
+    }
 }
 
-template <class Key, class Value>
-AVLTree<Key, Value>::~AVLTree()
+/**
+ * @brief 释放已经从树上摘下的所有结点，池中的结点按块释放，否则逐个释放；
+ * 结点外的值随ValueArena整体释放
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::releaseNodes(MyAVLTreeNode *root)
 {
-    destroy(root_);
+    if (kOutOfLine) {
+        if (deferred_) {
+            shared_ptr<ValueArena<Value>> values = make_shared<ValueArena<Value>>();
+            values->swap(values_);
+            TreeReclaimer::instance().post([values] { values->clear(); });
+        } else {
+            values_.clear();
+        }
+    }
+
+    if (kPooled) {
+        if (deferred_) {
+            vector<void *> blocks = pool_.takeBlocks();
+            TreeReclaimer::instance().post([blocks] { NodePool<MyAVLTreeNode>::freeBlocks(blocks); });
+        } else {
+            pool_.releaseAll();
+        }
+        return;
+    }
+
+    if (root == nullptr) {
+        return;
+    }
+    if (deferred_) {
+        TreeReclaimer::instance().post([root] { destroy(root); });
+    } else {
+        destroy(root);
+    }
 }
 
-template <class Key, class Value>
-Value *AVLTree<Key, Value>::get(MyAVLTreeNode *x, const Key &key)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+Value *AVLTree<Key, Value, NodeUpdate, ValueLayout>::get(MyAVLTreeNode *x, const Key &key)
 {
     if (x == nullptr) {
         return nullptr;
     }
 
     if (x->key == key) {
-        return x->value;
+        return &x->value;
     }
 
     if (key < x->key) {
@@ -137,9 +484,55 @@ Value *AVLTree<Key, Value>::get(MyAVLTreeNode *x, const Key &key)
     }
 }
 
-template <class Key, class Value>
-const typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::minimum(const MyAVLTreeNode *x)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::multiGet(const vector<Key> &keys, vector<Value *> &out)
+{
+    const int kGroup = 16;
+
+    MyAVLTreeNode *cursor[kGroup];
+    size_t index[kGroup];
+
+    out.assign(keys.size(), nullptr);
+    for (size_t base = 0; base < keys.size(); base += kGroup) {
+        size_t end = min(keys.size(), base + kGroup);
+
+        int active = 0;
+        for (size_t i = base; i < end; i++) {
+            if (filter_ != nullptr && !filter_->mayContain(keys[i])) {
+                continue;
+            }
+            cursor[active] = root_;
+            index[active] = i;
+            active++;
+        }
+
+        // 结束的查找用最后一个活动的查找填补，保持cursor紧凑
+        while (active > 0) {
+            for (int j = 0; j < active; ) {
+                MyAVLTreeNode *x = cursor[j];
+                const Key &key = keys[index[j]];
+
+                if (x == nullptr || x->key == key) {
+                    if (x != nullptr) {
+                        out[index[j]] = &x->value;
+                    }
+                    active--;
+                    cursor[j] = cursor[active];
+                    index[j] = index[active];
+                    continue;
+                }
+
+                x = key < x->key ? x->left : x->right;
+                prefetch(x);
+                cursor[j++] = x;
+            }
+        }
+    }
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+const typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::minimum(const MyAVLTreeNode *x)
 {
     if (x == nullptr) {
         return x;
@@ -152,9 +545,9 @@ AVLTree<Key, Value>::minimum(const MyAVLTreeNode *x)
     return minimum(x->left);
 }
 
-template <class Key, class Value>
-const typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::maximum(const MyAVLTreeNode *x)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+const typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::maximum(const MyAVLTreeNode *x)
 {
     if (x == nullptr) {
         return x;
@@ -167,27 +560,186 @@ AVLTree<Key, Value>::maximum(const MyAVLTreeNode *x)
     return maximum(x->right);
 }
 
-template <class Key, class Value>
-void AVLTree<Key, Value>::destroy(MyAVLTreeNode *x)
+/**
+ * 不断把x的左子结点右旋到x的位置，直到x没有左子树，再释放x并转到右子树，
+ * 每个结点最多参与一次旋转，不需要递归和额外的栈
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::destroy(MyAVLTreeNode *x)
+{
+    while (x != nullptr) {
+        if (x->left != nullptr) {
+            MyAVLTreeNode *left = x->left;
+            x->left = left->right;
+            left->right = x;
+            x = left;
+        } else {
+            MyAVLTreeNode *right = x->right;
+            delete x;
+            x = right;
+        }
+    }
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+template <class Hash>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::enableFilter(int expectedKeys, double fpRate)
+{
+    size_t capacity = static_cast<size_t>(max(expectedKeys, count_));
+    filter_.reset(new CountingBloomFilter<Key>(capacity, fpRate,
+                                               &CountingBloomFilter<Key>::template hashWith<Hash>));
+    fillFilter(root_);
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::rebuildFilter()
+{
+    if (filter_ == nullptr) {
+        return;
+    }
+
+    resetFilter(max(filter_->capacity(), static_cast<size_t>(count_)));
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::resetFilter(size_t capacity)
+{
+    filter_.reset(new CountingBloomFilter<Key>(capacity, filter_->fpRate(), filter_->hashFunc()));
+    fillFilter(root_);
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+TreeMemoryUsage AVLTree<Key, Value, NodeUpdate, ValueLayout>::memoryUsage()
+{
+    TreeMemoryUsage usage;
+    usage.entries = count_;
+    usage.nodeBytes = count_ * sizeof(MyAVLTreeNode);
+    if (kPooled) {
+        usage.allocatorOverhead = pool_.memoryUsage() - usage.nodeBytes;
+    } else {
+        usage.allocatorOverhead = count_ * (allocatedSize(sizeof(MyAVLTreeNode)) - sizeof(MyAVLTreeNode));
+    }
+    if (kOutOfLine) {
+        usage.nodeBytes += count_ * sizeof(Value);
+        usage.allocatorOverhead += values_.memoryUsage() - count_ * sizeof(Value);
+    }
+    usage.auxiliaryBytes = sizeof(*this);
+    if (filter_ != nullptr) {
+        usage.auxiliaryBytes += filter_->memoryUsage();
+    }
+    if (cache_ != nullptr) {
+        usage.auxiliaryBytes += cache_->memoryUsage();
+    }
+    return usage;
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::shrink()
+{
+    if (filter_ != nullptr) {
+        resetFilter(max(count_, 1));
+    }
+    size_t live = static_cast<size_t>(count_);
+    if ((kPooled && pool_.capacity() > 2 * live) || (kOutOfLine && values_.capacity() > 2 * live)) {
+        NodePool<MyAVLTreeNode> freshNodes;
+        ValueArena<Value> freshValues;
+        root_ = relocate(root_, freshNodes, freshValues);
+        pool_.swap(freshNodes);
+        values_.swap(freshValues);
+        if (cache_ != nullptr) {
+            cache_->clear();
+        }
+    }
+    trimHeap();
+}
+
+/**
+ * @brief 把以x为根的子树逐个复制到pool中，结点外的值复制到values中，返回新的根
+ * 池中的旧结点和旧的值留在原来的池和区域中整体释放，不在池中的旧结点逐个释放；
+ * 递归深度不超过树高
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::relocate(MyAVLTreeNode *x, NodePool<MyAVLTreeNode> &pool,
+                                                       ValueArena<Value> &values)
+{
+    if (x == nullptr) {
+        return nullptr;
+    }
+
+    MyAVLTreeNode *y = kPooled ? new (pool.allocate()) MyAVLTreeNode(x->key, x->value, values)
+                               : new MyAVLTreeNode(x->key, x->value, values);
+    static_cast<typename NodeUpdate::metadata &>(*y) = *x;
+    y->height = x->height;
+    y->left = relocate(x->left, pool, values);
+    y->right = relocate(x->right, pool, values);
+    if (x == minNode_) {
+        minNode_ = y;
+    }
+    if (x == maxNode_) {
+        maxNode_ = y;
+    }
+    if (!kPooled) {
+        delete x;
+    }
+    return y;
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::fillFilter(MyAVLTreeNode *x)
 {
     if (x == nullptr) {
         return;
     }
 
-    if (x->left != nullptr) {
-        destroy(x->left);
+    fillFilter(x->left);
+    filter_->add(x->key);
+    fillFilter(x->right);
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+template <class Hash>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::enableCache(int slots)
+{
+    cache_.reset(new NodeCache<Key, MyAVLTreeNode>(slots, &CountingBloomFilter<Key>::template hashWith<Hash>));
+}
+
+/**
+ * 未命中时沿树查找，找到的结点放入缓存
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+Value *AVLTree<Key, Value, NodeUpdate, ValueLayout>::cachedGet(const Key &key)
+{
+    MyAVLTreeNode *x = cache_->lookup(key);
+    if (x != nullptr) {
+        return &x->value;
     }
 
-    if (x->right != nullptr) {
-        destroy(x->right);
+    x = root_;
+    while (x != nullptr && !(x->key == key)) {
+        x = key < x->key ? x->left : x->right;
+    }
+    if (x == nullptr) {
+        return nullptr;
     }
 
-    count_--;
-    delete x;
+    cache_->insert(x);
+    return &x->value;
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::forgetNode(const MyAVLTreeNode *x)
+{
+    if (filter_ != nullptr) {
+        filter_->remove(x->key);
+    }
+    if (cache_ != nullptr) {
+        cache_->erase(x);
+    }
 }
 
-template <class Key, class Value>
-void AVLTree<Key, Value>::preOrder(MyAVLTreeNode *x)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::preOrder(MyAVLTreeNode *x)
 {
     if (x == nullptr) {
         return;
@@ -198,8 +750,8 @@ void AVLTree<Key, Value>::preOrder(MyAVLTreeNode *x)
     preOrder(x->right);
 }
 
-template <class Key, class Value>
-void AVLTree<Key, Value>::inOrder(MyAVLTreeNode *x)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::inOrder(MyAVLTreeNode *x)
 {
     if (x == nullptr) {
         return;
@@ -210,8 +762,8 @@ void AVLTree<Key, Value>::inOrder(MyAVLTreeNode *x)
     inOrder(x->right);
 }
 
-template <class Key, class Value>
-void AVLTree<Key, Value>::postOrder(MyAVLTreeNode *x)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::postOrder(MyAVLTreeNode *x)
 {
     if (x == nullptr) {
         return;
@@ -223,244 +775,684 @@ void AVLTree<Key, Value>::postOrder(MyAVLTreeNode *x)
 }
 
 /**
- * 新加入的结点在左子树的左子树上，导致左子树偏高
- *               O(root, x+3, diff=2)
- *       O(x+2)        O(x)
- *   O(x+1)   O(x)
+ * 只进入可能与[lo, hi]相交的子树
  */
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode*
-AVLTree<Key, Value>::LL(MyAVLTreeNode *root)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+template <class Func>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::forEach(MyAVLTreeNode *x, const Key &lo, const Key &hi, Func &fn)
 {
-    return rightRotate(root);;
+    if (x == nullptr) {
+        return;
+    }
+
+    if (lo < x->key) {
+        forEach(x->left, lo, hi, fn);
+    }
+    if (!(x->key < lo) && !(hi < x->key)) {
+        fn(x->key, x->value);
+    }
+    if (x->key < hi) {
+        forEach(x->right, lo, hi, fn);
+    }
 }
 
 /**
- * 新加入的结点在左子树的右子树上，导致左子树偏高
- *              O(root, x+3, diff = 2)
- *        O(x+2)          O(x)
- *   O(x)     O(x+1)
+ * 左子树作为任务提交到线程池，当前线程继续处理右子树，矮的子树串行处理
  */
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::LR(MyAVLTreeNode *root)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+template <class Func>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::parallelForEach(MyAVLTreeNode *x, const Key &lo, const Key &hi,
+                                                                   Func &fn, WorkStealingPool &pool)
 {
-    root->left = leftRotate(root->left);
-    return LL(root);
+    if (x == nullptr) {
+        return;
+    }
+    if (x->height <= kSerialHeight) {
+        forEach(x, lo, hi, fn);
+        return;
+    }
+
+    TaskGroup group(pool);
+    if (lo < x->key) {
+        group.run([this, x, &lo, &hi, &fn, &pool] { parallelForEach(x->left, lo, hi, fn, pool); });
+    }
+    if (!(x->key < lo) && !(hi < x->key)) {
+        fn(x->key, x->value);
+    }
+    if (x->key < hi) {
+        parallelForEach(x->right, lo, hi, fn, pool);
+    }
+    group.wait();
 }
 
 /**
- * 新加入的结点在右子树的右子树上，导致右子树偏高
- *               O(root, x+3, diff=2)
- *       O(x)          O(x+2)
- *                 O(x)   O(x+1)
+ * 左子树的结果由任务写回，三部分按左子树、x、右子树的顺序合并；
+ * 矮的子树按中序从左到右累积，不需要为每个空子树合并一次init
  */
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::RR(MyAVLTreeNode *root)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+template <class T, class Map, class Combine>
+T AVLTree<Key, Value, NodeUpdate, ValueLayout>::parallelReduce(MyAVLTreeNode *x, const Key &lo, const Key &hi,
+                                                               const T &init, Map &map, Combine &combine,
+                                                               WorkStealingPool &pool)
 {
-    return leftRotate(root);
+    if (x == nullptr) {
+        return init;
+    }
+
+    if (x->height <= kSerialHeight) {
+        T result = init;
+        auto accumulate = [&result, &map, &combine](const Key &key, Value &value) {
+            result = combine(result, map(key, value));
+        };
+        forEach(x, lo, hi, accumulate);
+        return result;
+    }
+
+    T left = init;
+    T right = init;
+    {
+        TaskGroup group(pool);
+        if (lo < x->key) {
+            group.run([this, x, &lo, &hi, &init, &map, &combine, &pool, &left] {
+                left = parallelReduce(x->left, lo, hi, init, map, combine, pool);
+            });
+        }
+        if (x->key < hi) {
+            right = parallelReduce(x->right, lo, hi, init, map, combine, pool);
+        }
+        group.wait();
+    }
+
+    if (!(x->key < lo) && !(hi < x->key)) {
+        left = combine(left, map(x->key, x->value));
+    }
+    return combine(left, right);
 }
 
 /**
- * 新加入的结点在右子树的左子树上，导致右子树偏高
- *               O(root, x+3, diff=2)
- *       O(x)          O(x+2)
- *                 O(x+1)   O(x)
+ * 由左右子树重新计算x的高度和附加信息
  */
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::RL(MyAVLTreeNode *root)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::updateNode(MyAVLTreeNode *x)
 {
-    root->right = rightRotate(root->right);
-    return RR(root);
+    x->height = max(getNodeHeight(x->left), getNodeHeight(x->right)) + 1;
+    NodeUpdate::update(x);
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::put(MyAVLTreeNode *x, const Key &key, const Value &val, Value *&slot)
+{
+    if (x == nullptr) {
+        MyAVLTreeNode *node = createNode(key, val);
+        slot = &node->value;
+        return node;
+    }
+
+    MyAVLTreeNode *newRoot = nullptr;
+    if (key < x->key) {
+        x->left = put(x->left, key, val, slot); // x的左子树必然有结点
+        newRoot = rebalance(x);
+    } else if (key > x->key) {
+        x->right = put(x->right, key, val, slot);
+        newRoot = rebalance(x);
+    } else {
+        newRoot = x;
+        newRoot->value = val;
+        slot = &newRoot->value;
+        updateNode(newRoot);
+    }
+
+    return newRoot;
 }
 
 /**
- * 按照root为根结点，进行左旋
- *   O(root)                     O(newRoot)
- *       O           ==>  O(oldRoot)     O
- *           O
+ * @brief 从子树x中摘下最小的结点(不释放)，返回新的子树根
+ * minNode返回被摘下的结点，newMin返回子树中新的最小结点：
+ * 被摘下的结点没有左子树，若它有右子树，新的最小结点是右子树的最小结点，
+ * 否则是它的父结点，由上一层递归填入；旋转不改变中序，因此结果不受rebalance影响
  */
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::leftRotate(MyAVLTreeNode *root)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::detachMin(MyAVLTreeNode *x, MyAVLTreeNode *&minNode, MyAVLTreeNode *&newMin)
 {
-    if (root == nullptr || root->right == nullptr) {
-        return root;
+    if (x->left == nullptr) {
+        minNode = x;
+        newMin = const_cast<MyAVLTreeNode *>(minimum(x->right));
+        return x->right;
     }
 
-    MyAVLTreeNode *oldRoot = root;
-    MyAVLTreeNode *newRoot = root->right;
-
-    oldRoot->right = newRoot->left;
-    newRoot->left = oldRoot;
+    x->left = detachMin(x->left, minNode, newMin);
+    if (newMin == nullptr) {
+        newMin = x;
+    }
+    return rebalance(x);
+}
 
-    oldRoot->height = max(getNodeHeight(oldRoot->left), getNodeHeight(oldRoot->right)) + 1;
-    newRoot->height = max(getNodeHeight(newRoot->left), getNodeHeight(newRoot->right)) + 1;
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::detachMax(MyAVLTreeNode *x, MyAVLTreeNode *&maxNode, MyAVLTreeNode *&newMax)
+{
+    if (x->right == nullptr) {
+        maxNode = x;
+        newMax = const_cast<MyAVLTreeNode *>(maximum(x->left));
+        return x->left;
+    }
 
-    return newRoot;
+    x->right = detachMax(x->right, maxNode, newMax);
+    if (newMax == nullptr) {
+        newMax = x;
+    }
+    return rebalance(x);
 }
 
 /**
- * 按照root为根结点，进行左旋
- *              O(root)             O(newRoot)
- *         O            ==>    O         O(oldRoot)
- *    O
+ * @brief 从整棵树中摘下最小的结点，同时更新缓存的最小、最大结点
  */
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::rightRotate(MyAVLTreeNode *root)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::detachMin()
 {
-    if (root == nullptr || root->left == nullptr) {
-        return root;
+    MyAVLTreeNode *minNode = nullptr;
+    MyAVLTreeNode *newMin = nullptr;
+
+    root_ = detachMin(root_, minNode, newMin);
+    count_--;
+    forgetNode(minNode);
+
+    minNode_ = newMin;
+    if (count_ == 0) {
+        maxNode_ = nullptr;
     }
+    return minNode;
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::detachMax()
+{
+    MyAVLTreeNode *maxNode = nullptr;
+    MyAVLTreeNode *newMax = nullptr;
 
-    MyAVLTreeNode *oldRoot = root;
-    MyAVLTreeNode *newRoot = root->left;
+    root_ = detachMax(root_, maxNode, newMax);
+    count_--;
+    forgetNode(maxNode);
 
-    oldRoot->left = newRoot->right;
-    newRoot->right = oldRoot;
+    maxNode_ = newMax;
+    if (count_ == 0) {
+        minNode_ = nullptr;
+    }
+    return maxNode;
+}
 
-    oldRoot->height = max(getNodeHeight(oldRoot->left), getNodeHeight(oldRoot->right)) + 1;
-    newRoot->height = max(getNodeHeight(newRoot->left), getNodeHeight(newRoot->right)) + 1;
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+pair<Key, Value> AVLTree<Key, Value, NodeUpdate, ValueLayout>::popMin()
+{
+    assert(count_ != 0);
 
-    return newRoot;
+    MyAVLTreeNode *node = detachMin();
+    pair<Key, Value> item(node->key, node->value);
+    freeNode(node);
+    return item;
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+pair<Key, Value> AVLTree<Key, Value, NodeUpdate, ValueLayout>::popMax()
+{
+    assert(count_ != 0);
+
+    MyAVLTreeNode *node = detachMax();
+    pair<Key, Value> item(node->key, node->value);
+    freeNode(node);
+    return item;
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+vector<pair<Key, Value>> AVLTree<Key, Value, NodeUpdate, ValueLayout>::popMin(int k)
+{
+    vector<pair<Key, Value>> items;
+    items.reserve(min(max(k, 0), count_));
+
+    while (k-- > 0 && count_ != 0) {
+        MyAVLTreeNode *node = detachMin();
+        items.emplace_back(node->key, node->value);
+        freeNode(node);
+    }
+
+    return items;
 }
 
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::rebalance(MyAVLTreeNode *x)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::deleteKey(MyAVLTreeNode *x, const Key &key)
 {
     if (x == nullptr) {
         return x;
     }
 
-    MyAVLTreeNode *leftNode = x->left;
-    MyAVLTreeNode *rightNode = x->right;
-    MyAVLTreeNode *newRoot = x; // default
+    MyAVLTreeNode *newX = nullptr;
+    if (key < x->key) {
+        x->left = deleteKey(x->left, key);
+        if (minNode_ == nullptr) {
+            minNode_ = x; // 被删除的最小结点没有右子树，x成为新的最小结点
+        }
+        newX = rebalance(x);
+    } else if (key > x->key) {
+        x->right = deleteKey(x->right, key);
+        if (maxNode_ == nullptr) {
+            maxNode_ = x;
+        }
+        newX = rebalance(x);
+    } else {
+        newX = unlinkNode(x);
+    }
+
+    return newX;
+}
 
-    int leftHight = getNodeHeight(leftNode);
-    int rightHight = getNodeHeight(rightNode);
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+bool AVLTree<Key, Value, NodeUpdate, ValueLayout>::floor(const Key &key, Key &result)
+{
+    const MyAVLTreeNode *best = nullptr;
 
-    if (leftHight - rightHight > 1) {
-        if (getNodeHeight(leftNode->left) > getNodeHeight(leftNode->right)) {
-            newRoot = LL(x);
+    const MyAVLTreeNode *x = root_;
+    while (x != nullptr) {
+        if (key < x->key) {
+            x = x->left;
         } else {
-            newRoot = LR(x);
+            best = x;
+            if (x->key == key) {
+                break;
+            }
+            x = x->right;
         }
-    } else if (leftHight - rightHight < -1) {
-        if (getNodeHeight(rightNode->right) > getNodeHeight(rightNode->left)) {
-            newRoot = RR(x);
+    }
+
+    if (best == nullptr) {
+        return false;
+    }
+    result = best->key;
+    return true;
+}
+
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+bool AVLTree<Key, Value, NodeUpdate, ValueLayout>::ceiling(const Key &key, Key &result)
+{
+    const MyAVLTreeNode *best = nullptr;
+
+    const MyAVLTreeNode *x = root_;
+    while (x != nullptr) {
+        if (x->key < key) {
+            x = x->right;
         } else {
-            newRoot = RL(x);
+            best = x;
+            if (x->key == key) {
+                break;
+            }
+            x = x->left;
         }
-    } else {
-        newRoot->height = max(getNodeHeight(newRoot->left), getNodeHeight(newRoot->right)) + 1;        
     }
 
-    return newRoot;
+    if (best == nullptr) {
+        return false;
+    }
+    result = best->key;
+    return true;
+}
+
+/**
+ * 两个栈就是两个方向的中序迭代器：
+ * 后继栈的栈顶是>=key的最小结点，弹出x后压入x的右子树的左边界；
+ * 前驱栈的栈顶是<key的最大结点，弹出x后压入x的左子树的右边界
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::kNearest(const Key &key, int k, vector<pair<Key, Value *>> &out)
+{
+    MyAVLTreeNode *preds[kMaxHeight];
+    MyAVLTreeNode *succs[kMaxHeight];
+    int predTop = 0;
+    int succTop = 0;
+
+    out.clear();
+    for (MyAVLTreeNode *x = root_; x != nullptr; ) {
+        if (x->key < key) {
+            preds[predTop++] = x;
+            x = x->right;
+        } else {
+            succs[succTop++] = x;
+            x = x->left;
+        }
+    }
+
+    while (static_cast<int>(out.size()) < k && (predTop > 0 || succTop > 0)) {
+        bool takePred = succTop == 0 ||
+                        (predTop > 0 && !(key - preds[predTop - 1]->key > succs[succTop - 1]->key - key));
+        if (takePred) {
+            MyAVLTreeNode *x = preds[--predTop];
+            out.emplace_back(x->key, &x->value);
+            for (MyAVLTreeNode *y = x->left; y != nullptr; y = y->right) {
+                preds[predTop++] = y;
+            }
+        } else {
+            MyAVLTreeNode *x = succs[--succTop];
+            out.emplace_back(x->key, &x->value);
+            for (MyAVLTreeNode *y = x->right; y != nullptr; y = y->left) {
+                succs[succTop++] = y;
+            }
+        }
+    }
+}
+
+/**
+ * 路径上每个结点记录下降到它时的上下界：lower是最近一个向右走的祖先(小于子树中所有的键)，
+ * upper是最近一个向左走的祖先(大于子树中所有的键)
+ * 下一个键不小于upper时，结果不在这棵子树中，弹出；否则从这个结点重新下降，初始结果为lower
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::floorMany(const vector<Key> &sortedKeys,
+                                                             vector<pair<Key, Value *>> &out)
+{
+    struct PathEntry {
+        MyAVLTreeNode *node;
+        MyAVLTreeNode *lower;
+        MyAVLTreeNode *upper;
+    };
+    PathEntry path[kMaxHeight];
+    int top = 0;
+
+    out.assign(sortedKeys.size(), pair<Key, Value *>(Key(), nullptr));
+    for (size_t i = 0; i < sortedKeys.size(); i++) {
+        const Key &key = sortedKeys[i];
+        assert(i == 0 || !(key < sortedKeys[i - 1]));
+
+        while (top > 0 && path[top - 1].upper != nullptr && !(key < path[top - 1].upper->key)) {
+            top--;
+        }
+
+        MyAVLTreeNode *x = root_;
+        MyAVLTreeNode *lower = nullptr;
+        MyAVLTreeNode *upper = nullptr;
+        if (top > 0) {
+            top--;
+            x = path[top].node;
+            lower = path[top].lower;
+            upper = path[top].upper;
+        }
+
+        MyAVLTreeNode *best = lower;
+        while (x != nullptr) {
+            path[top++] = PathEntry{x, lower, upper};
+            if (key < x->key) {
+                upper = x;
+                x = x->left;
+            } else {
+                best = x;
+                if (x->key == key) {
+                    break;
+                }
+                lower = x;
+                x = x->right;
+            }
+        }
+
+        if (best != nullptr) {
+            out[i] = pair<Key, Value *>(best->key, &best->value);
+        }
+    }
 }
 
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::put(MyAVLTreeNode *x, const Key &key, const Value &val)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+int AVLTree<Key, Value, NodeUpdate, ValueLayout>::deleteRange(const Key &lo, const Key &hi)
+{
+    if (root_ == nullptr || hi < lo) {
+        return 0;
+    }
+
+    MyAVLTreeNode *left = nullptr;
+    MyAVLTreeNode *rest = nullptr;
+    MyAVLTreeNode *mid = nullptr;
+    MyAVLTreeNode *right = nullptr;
+
+    split(root_, lo, false, left, rest);
+    split(rest, hi, true, mid, right);
+    root_ = join(left, right);
+
+    int removed = releaseRange(mid);
+    if (removed != 0) {
+        minNode_ = const_cast<MyAVLTreeNode *>(minimum(root_));
+        maxNode_ = const_cast<MyAVLTreeNode *>(maximum(root_));
+    }
+    return removed;
+}
+
+/**
+ * @brief 把子树x分裂成left(键小于key，inclusive时小于等于key)和right两棵AVL树
+ * 沿查找路径下降，回溯时把路径上的结点和它另一侧的子树连接到对应的一边
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::split(MyAVLTreeNode *x, const Key &key, bool inclusive,
+                                            MyAVLTreeNode *&left, MyAVLTreeNode *&right)
 {
     if (x == nullptr) {
-        count_++;
-        return new MyAVLTreeNode(key, val);
+        left = nullptr;
+        right = nullptr;
+        return;
     }
 
-    MyAVLTreeNode *newRoot = nullptr;
-    if (key < x->key) {
-        x->left = put(x->left, key, val); // x的左子树必然有结点
-        newRoot = rebalance(x);
-    } else if (key > x->key) {
-        x->right = put(x->right, key, val);
-        newRoot = rebalance(x);
+    if (x->key < key || (inclusive && x->key == key)) {
+        MyAVLTreeNode *l = nullptr;
+        split(x->right, key, inclusive, l, right);
+        left = join(x->left, x, l);
     } else {
-        newRoot = x;
-        newRoot->value = val;
+        MyAVLTreeNode *r = nullptr;
+        split(x->left, key, inclusive, left, r);
+        right = join(r, x, x->right);
     }
+}
 
-    return newRoot;
+/**
+ * @brief left中的键都小于mid，right中的键都大于mid，以mid连接两棵AVL树
+ * 沿较高一棵的边界下降到与较矮一棵高度相差不超过1的位置挂上mid，回溯时重新平衡，
+ * 复杂度为O(|h(left) - h(right)| + 1)
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::join(MyAVLTreeNode *left, MyAVLTreeNode *mid, MyAVLTreeNode *right)
+{
+    if (getNodeHeight(left) > getNodeHeight(right) + 1) {
+        left->right = join(left->right, mid, right);
+        return rebalance(left);
+    }
+    if (getNodeHeight(right) > getNodeHeight(left) + 1) {
+        right->left = join(left, mid, right->left);
+        return rebalance(right);
+    }
+
+    mid->left = left;
+    mid->right = right;
+    updateNode(mid);
+    return mid;
 }
 
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::deleteMin(MyAVLTreeNode *x)
+/**
+ * @brief 没有中间结点时，从right中摘下最小的结点作为中间结点
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::join(MyAVLTreeNode *left, MyAVLTreeNode *right)
 {
-    if (x == nullptr) {
-        return x;
+    if (right == nullptr) {
+        return left;
     }
 
-    if (x->left == nullptr) {
-        MyAVLTreeNode *rightNode = x->right;
-        delete x;
-        count_ --;
-        return rightNode;
+    MyAVLTreeNode *mid = nullptr;
+    MyAVLTreeNode *newMin = nullptr;
+    right = detachMin(right, mid, newMin);
+    return join(left, mid, right);
+}
+
+/**
+ * @brief 释放已经从树上分裂出来的子树x，同步过滤器和缓存，返回结点个数
+ * 与destroy一样用旋转代替递归
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+int AVLTree<Key, Value, NodeUpdate, ValueLayout>::releaseRange(MyAVLTreeNode *x)
+{
+    int removed = 0;
+    while (x != nullptr) {
+        if (x->left != nullptr) {
+            MyAVLTreeNode *left = x->left;
+            x->left = left->right;
+            left->right = x;
+            x = left;
+        } else {
+            MyAVLTreeNode *right = x->right;
+            forgetNode(x);
+            freeNode(x);
+            removed++;
+            x = right;
+        }
     }
 
-    x->left = deleteMin(x->left);
-    return rebalance(x);
+    count_ -= removed;
+    return removed;
 }
 
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::deleteMax(MyAVLTreeNode *x)
+/**
+ * @brief 分配新结点并登记到计数、过滤器和最小、最大结点缓存中
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::createNode(const Key &key, const Value &val)
 {
-    if (x == nullptr) {
-        return x;
+    count_++;
+    MyAVLTreeNode *node = allocNode(key, val);
+    updateNode(node);
+    if (filter_ != nullptr) {
+        filter_->add(key);
     }
 
-    if (x->right == nullptr) {
-        MyAVLTreeNode *leftNode = x->left;
-        delete x;
-        count_ --;
-        return leftNode;
+    if (minNode_ == nullptr || key < minNode_->key) {
+        minNode_ = node;
     }
+    if (maxNode_ == nullptr || key > maxNode_->key) {
+        maxNode_ = node;
+    }
+    return node;
+}
 
-    x->right = deleteMax(x->right);
-    return rebalance(x);
+/**
+ * @brief 删除结点x并释放，返回替代x的子树根
+ * 删除有两个子结点的结点时，把右子树的最小结点摘下来接到被删除结点的位置，
+ * 不复制结点，其它结点的地址在删除前后保持不变
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::unlinkNode(MyAVLTreeNode *x)
+{
+    MyAVLTreeNode *newX = nullptr;
+    if (x->left == nullptr || x->right == nullptr) {
+        newX = x->left != nullptr ? x->left : x->right;
+        if (x == minNode_) {
+            minNode_ = const_cast<MyAVLTreeNode *>(minimum(x->right));
+        }
+        if (x == maxNode_) {
+            maxNode_ = const_cast<MyAVLTreeNode *>(maximum(x->left));
+        }
+    } else {
+        MyAVLTreeNode *successor = nullptr;
+        MyAVLTreeNode *newMin = nullptr;
+
+        MyAVLTreeNode *right = detachMin(x->right, successor, newMin);
+        successor->right = right;
+        successor->left = x->left;
+
+        newX = rebalance(successor);
+    }
+
+    forgetNode(x);
+    freeNode(x);
+    count_--;
+
+    return newX;
+}
+
+/**
+ * @brief 插入新结点之后：键的数量超过过滤器容量的2倍时重建过滤器，检查内存预算
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+void AVLTree<Key, Value, NodeUpdate, ValueLayout>::afterInsert()
+{
+    if (filter_ != nullptr && count_ > 2 * static_cast<int>(filter_->capacity())) {
+        rebuildFilter();
+    }
+    if (budget_.enabled()) {
+        budget_.check(memoryUsage());
+    }
 }
 
-template <class Key, class Value>
-typename AVLTree<Key, Value>::MyAVLTreeNode *
-AVLTree<Key, Value>::deleteKey(MyAVLTreeNode *x, const Key &key)
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+template <class Func>
+bool AVLTree<Key, Value, NodeUpdate, ValueLayout>::compute(const Key &key, Func fn)
+{
+    bool changed = false;
+    bool exists = false;
+
+    root_ = compute(root_, key, fn, changed, exists);
+    if (changed && exists) {
+        afterInsert();
+    }
+
+    return exists;
+}
+
+/**
+ * @brief 与put/deleteKey相同的一次下降，changed表示是否插入或删除了结点，exists表示键最终是否存在
+ * 结构没有变化时高度不变，回溯时只重新计算附加信息，不做旋转
+ */
+template <class Key, class Value, class NodeUpdate, class ValueLayout>
+template <class Func>
+typename AVLTree<Key, Value, NodeUpdate, ValueLayout>::MyAVLTreeNode *
+AVLTree<Key, Value, NodeUpdate, ValueLayout>::compute(MyAVLTreeNode *x, const Key &key, Func &fn, bool &changed, bool &exists)
 {
     if (x == nullptr) {
-        return x;
+        Value val = Value();
+        if (!fn(val, false)) {
+            return nullptr;
+        }
+
+        changed = true;
+        exists = true;
+        return createNode(key, val);
     }
 
-    MyAVLTreeNode *newX = nullptr;
     if (key < x->key) {
-        x->left = deleteKey(x->left, key);
-        newX = rebalance(x);
+        x->left = compute(x->left, key, fn, changed, exists);
+        if (minNode_ == nullptr) {
+            minNode_ = x;
+        }
     } else if (key > x->key) {
-        x->right = deleteKey(x->right, key);
-        newX = rebalance(x);
+        x->right = compute(x->right, key, fn, changed, exists);
+        if (maxNode_ == nullptr) {
+            maxNode_ = x;
+        }
     } else {
-        if (x->left == nullptr) {
-            newX = x->right;
-            delete x;
-            count_ --;
-        } else if (x->right == nullptr) {
-            newX = x->left;
-            delete x;
-            count_ --;
-        } else {
-            MyAVLTreeNode *successor = new MyAVLTreeNode(*minimum(x->right));
+        if (fn(x->value, true)) {
+            exists = true;
+            NodeUpdate::update(x);
+            return x;
+        }
 
-            successor->right = deleteMin(x->right);
-            successor->left = x->left;
-            successor->height = max(getNodeHeight(successor->left), getNodeHeight(successor->right)) + 1;
+        changed = true;
+        return unlinkNode(x);
+    }
 
-            newX = rebalance(successor);
-            delete x;
-        }
+    if (changed) {
+        return rebalance(x);
     }
 
-    return newX;
+    NodeUpdate::update(x);
+    return x;
 }
 
 #endif
\ No newline at end of file
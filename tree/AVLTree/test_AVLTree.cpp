@@ -34,5 +34,110 @@ int main(int argc, char **argv)
     cout << "MAX: " << avl.maximum() << endl;
     cout << "MIN: " << avl.minimum() << endl;
 
+    pair<int, int> item = avl.popMin();
+    cout << "popMin: (" << item.first << ", " << item.second << ")" << endl;
+    item = avl.popMax();
+    cout << "popMax: (" << item.first << ", " << item.second << ")" << endl;
+
+    avl.enableFilter(100);
+    avl.put(42, 1);
+    cout << "contain(42): " << avl.contain(42) << ", contain(43): " << avl.contain(43) << endl;
+
+    avl.enableCache(16);
+    for (int i = 0; i < 10; i++) {
+        avl.get(42);
+    }
+    cout << "cache hits: " << avl.cacheHits() << ", misses: " << avl.cacheMisses() << endl;
+
+    AVLTree<int, int> counter;
+    int words[] = {3, 1, 3, 2, 3, 1};
+    for (int w : words) {
+        counter.upsert(w, [](int &count) { count++; });
+    }
+    counter.compute(2, [](int &count, bool) { return --count > 0; });
+    counter.inOrder();
+
+    vector<int> keys = {1, 2, 3, 4};
+    vector<int *> values;
+    counter.multiGet(keys, values);
+    for (size_t i = 0; i < keys.size(); i++) {
+        cout << "multiGet(" << keys[i] << "): ";
+        if (values[i] != nullptr) {
+            cout << *values[i] << endl;
+        } else {
+            cout << "none" << endl;
+        }
+    }
+
+    avl.setMemoryBudget(1024, [](const TreeMemoryUsage &usage) {
+        cout << "over budget: " << usage.totalBytes() << " bytes, " << usage.entries << " entries" << endl;
+    });
+    for (int i = 100; i < 200; i++) {
+        avl.put(i, i);
+    }
+    TreeMemoryUsage usage = avl.memoryUsage();
+    cout << "memory: " << usage.totalBytes() << " bytes, " << usage.bytesPerEntry() << " bytes per entry" << endl;
+    while (avl.size() > 10) {
+        avl.deleteMax();
+    }
+    avl.shrink();
+    cout << "after shrink: " << avl.memoryUsage().totalBytes() << " bytes" << endl;
+
+    // 按时间窗口批量过期
+    AVLTree<int, int> window;
+    for (int t = 0; t < 100; t++) {
+        window.put(t, t);
+    }
+    cout << "expired: " << window.deleteRange(0, 89) << ", left: " << window.size()
+         << ", min: " << window.minimum() << endl;
+
+    // 值放在结点外，结点只有键、链接和对值的引用
+    AVLTree<int, int, AVLNullNodeUpdate, OutOfLineValueLayout> separated;
+    for (int i = 0; i < 10; i++) {
+        separated.put(i, i * i);
+    }
+    cout << "out-of-line get(9): " << *separated.get(9)
+         << ", node bytes: " << sizeof(AVLTree<int, int, AVLNullNodeUpdate, OutOfLineValueLayout>::MyAVLTreeNode) << endl;
+
+    // 全表并行求和
+    AVLTree<int, long long> table;
+    for (int i = 0; i < 100000; i++) {
+        table.put(i, i);
+    }
+    long long total = table.parallelReduce(0, 99999, 0LL,
+        [](const int &, const long long &value) { return value; },
+        [](long long a, long long b) { return a + b; });
+    cout << "parallelReduce sum: " << total << endl;
+
+    // 按桶的下界查找，离某个键最近的几个键
+    AVLTree<int, int> buckets;
+    for (int i = 0; i < 10; i++) {
+        buckets.put(i * 10, i);
+    }
+    int bound;
+    if (buckets.floor(35, bound)) {
+        cout << "floor(35): " << bound;
+    }
+    if (buckets.ceiling(35, bound)) {
+        cout << ", ceiling(35): " << bound << endl;
+    }
+    vector<pair<int, int *>> hits;
+    buckets.floorMany(vector<int>{-1, 5, 20, 21, 99}, hits);
+    cout << "floorMany:";
+    for (auto &hit : hits) {
+        if (hit.second != nullptr) {
+            cout << " " << hit.first;
+        } else {
+            cout << " -";
+        }
+    }
+    cout << endl;
+    buckets.kNearest(42, 3, hits);
+    cout << "kNearest(42, 3):";
+    for (auto &hit : hits) {
+        cout << " " << hit.first;
+    }
+    cout << endl;
+
     return 0;
 }
\ No newline at end of file
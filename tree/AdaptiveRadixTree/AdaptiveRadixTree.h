@@ -0,0 +1,922 @@
+#ifndef __ADAPTIVERADIXTREE_H_
+#define __ADAPTIVERADIXTREE_H_
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+using namespace std;
+
+/**
+ * 字符串键的自适应基数树(ART)
+ * 1. 每个内部结点按键的一个字节分叉，根据子结点的数量在Node4/Node16/Node48/Node256
+ *    之间自动扩张和收缩，Node4/Node16保存有序的字节数组，Node48用256字节的下标表，
+ *    Node256直接按字节寻址
+ * 2. 路径压缩：只有一个分叉的路径合并到下层结点的prefix中，叶子保存完整的键，
+ *    所以一次查找只比较键的每个字节各一次，代价与键长成正比，与n无关
+ * 3. 某个键恰好在内部结点处结束(是其它键的前缀)时，存放在该结点的terminal中，
+ *    按字典序它排在所有子结点之前
+ * 4. 内部结点记录子树中键的数量，rank/select/floor/ceiling沿一条路径完成
+ */
+template <class Value>
+class AdaptiveRadixTree {
+public:
+    AdaptiveRadixTree();
+    ~AdaptiveRadixTree();
+
+    AdaptiveRadixTree(const AdaptiveRadixTree &) = delete;
+    AdaptiveRadixTree &operator=(const AdaptiveRadixTree &) = delete;
+
+public:
+    int size() { return count_; }
+    bool isEmpty() { return count_ == 0; }
+    bool contain(const string &key) { return get(key) != nullptr; }
+
+    Value *get(const string &key);
+    void put(const string &key, const Value &val);
+    void deleteKey(const string &key);
+
+    string minimum();
+    string maximum();
+    void deleteMin();
+    void deleteMax();
+
+    /* 小于等于key的最大键，不存在时返回false */
+    bool floor(const string &key, string &result);
+
+    /* 大于等于key的最小键，不存在时返回false */
+    bool ceiling(const string &key, string &result);
+
+    /* 小于key的键的数量 */
+    int rank(const string &key);
+
+    /* 排名为k(从0开始)的键 */
+    string select(int k);
+
+    /* [lo, hi]之间键的数量 */
+    int size(const string &lo, const string &hi);
+
+    /* 按键的升序访问[lo, hi]之间的所有键值对，fn(key, value) */
+    template <class Func>
+    void forEach(const string &lo, const string &hi, Func fn);
+
+private:
+    enum NodeType : uint8_t { kLeaf, kNode4, kNode16, kNode48, kNode256 };
+
+    struct Node {
+        NodeType type;
+        explicit Node(NodeType t) : type(t) {}
+    };
+
+    struct Leaf : Node {
+        string key;
+        Value value;
+        Leaf(const string &k, const Value &v) : Node(kLeaf), key(k), value(v) {}
+    };
+
+    struct Inner : Node {
+        uint16_t num;       // 子结点的数量，不含terminal
+        int count;          // 子树中键的数量
+        string prefix;      // 压缩的路径
+        Leaf *terminal;     // 在本结点结束的键
+        explicit Inner(NodeType t) : Node(t), num(0), count(0), terminal(nullptr) {}
+    };
+
+    struct Node4 : Inner {
+        uint8_t keys[4];
+        Node *children[4];
+        Node4() : Inner(kNode4) {}
+    };
+
+    struct Node16 : Inner {
+        uint8_t keys[16];
+        Node *children[16];
+        Node16() : Inner(kNode16) {}
+    };
+
+    struct Node48 : Inner {
+        uint8_t index[256];  // 子结点下标 + 1，0表示不存在
+        Node *children[48];
+        Node48() : Inner(kNode48) { memset(index, 0, sizeof(index)); }
+    };
+
+    struct Node256 : Inner {
+        Node *children[256];
+        Node256() : Inner(kNode256) { memset(children, 0, sizeof(children)); }
+    };
+
+    static uint8_t byteAt(const string &key, size_t i) { return static_cast<uint8_t>(key[i]); }
+    static int nodeCount(const Node *x) { return x->type == kLeaf ? 1 : static_cast<const Inner *>(x)->count; }
+
+    static size_t prefixMismatch(const Inner *n, const string &key, size_t depth);
+    static void sortedArrays(Inner *n, uint8_t *&keys, Node **&children);
+
+    static Node **findChild(Inner *n, uint8_t c);
+    static void addChild(Node *&ref, uint8_t c, Node *child);
+    static void removeChild(Node *&ref, uint8_t c);
+    static void grow(Node *&ref);
+    static void shrink(Node *&ref);
+    static void collapse(Node *&ref);
+    static void placeLeaf(Inner *n, Leaf *leaf, size_t depth);
+
+    /* 按字节升序访问n的子结点，fn(c, child)返回false时停止 */
+    template <class Func>
+    static bool forEachChild(Inner *n, Func fn);
+    static Node *lastChild(Inner *n);
+
+    static void copyHeader(Inner *to, Inner *from);
+    static void freeNode(Node *x);
+    static void destroy(Node *x);
+
+    bool put(Node *&ref, const string &key, size_t depth, const Value &val);
+    bool deleteKey(Node *&ref, const string &key, size_t depth);
+
+    template <class Func>
+    bool forEach(Node *x, string &path, const string &lo, const string &hi, Func &fn);
+
+private:
+    Node *root_;
+    int count_;
+};
+
+template <class Value>
+AdaptiveRadixTree<Value>::AdaptiveRadixTree()
+{
+    root_ = nullptr;
+    count_ = 0;
+}
+
+template <class Value>
+AdaptiveRadixTree<Value>::~AdaptiveRadixTree()
+{
+    destroy(root_);
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::freeNode(Node *x)
+{
+    switch (x->type) {
+        case kLeaf:    delete static_cast<Leaf *>(x); break;
+        case kNode4:   delete static_cast<Node4 *>(x); break;
+        case kNode16:  delete static_cast<Node16 *>(x); break;
+        case kNode48:  delete static_cast<Node48 *>(x); break;
+        case kNode256: delete static_cast<Node256 *>(x); break;
+    }
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::destroy(Node *x)
+{
+    if (x == nullptr) {
+        return;
+    }
+
+    if (x->type != kLeaf) {
+        Inner *n = static_cast<Inner *>(x);
+        delete n->terminal;
+        forEachChild(n, [](uint8_t, Node *child) { destroy(child); return true; });
+    }
+    freeNode(x);
+}
+
+template <class Value>
+size_t AdaptiveRadixTree<Value>::prefixMismatch(const Inner *n, const string &key, size_t depth)
+{
+    size_t i = 0;
+    while (i < n->prefix.size() && depth + i < key.size() && n->prefix[i] == key[depth + i]) {
+        i++;
+    }
+    return i;
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::sortedArrays(Inner *n, uint8_t *&keys, Node **&children)
+{
+    if (n->type == kNode4) {
+        keys = static_cast<Node4 *>(n)->keys;
+        children = static_cast<Node4 *>(n)->children;
+    } else {
+        keys = static_cast<Node16 *>(n)->keys;
+        children = static_cast<Node16 *>(n)->children;
+    }
+}
+
+template <class Value>
+typename AdaptiveRadixTree<Value>::Node **
+AdaptiveRadixTree<Value>::findChild(Inner *n, uint8_t c)
+{
+    switch (n->type) {
+        case kNode4:
+        case kNode16: {
+            uint8_t *keys;
+            Node **children;
+            sortedArrays(n, keys, children);
+            for (int i = 0; i < n->num && keys[i] <= c; i++) {
+                if (keys[i] == c) {
+                    return &children[i];
+                }
+            }
+            return nullptr;
+        }
+        case kNode48: {
+            Node48 *x = static_cast<Node48 *>(n);
+            return x->index[c] ? &x->children[x->index[c] - 1] : nullptr;
+        }
+        default: {
+            Node256 *x = static_cast<Node256 *>(n);
+            return x->children[c] ? &x->children[c] : nullptr;
+        }
+    }
+}
+
+template <class Value>
+template <class Func>
+bool AdaptiveRadixTree<Value>::forEachChild(Inner *n, Func fn)
+{
+    switch (n->type) {
+        case kNode4:
+        case kNode16: {
+            uint8_t *keys;
+            Node **children;
+            sortedArrays(n, keys, children);
+            for (int i = 0; i < n->num; i++) {
+                if (!fn(keys[i], children[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case kNode48: {
+            Node48 *x = static_cast<Node48 *>(n);
+            for (int c = 0; c < 256; c++) {
+                if (x->index[c] && !fn(static_cast<uint8_t>(c), x->children[x->index[c] - 1])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default: {
+            Node256 *x = static_cast<Node256 *>(n);
+            for (int c = 0; c < 256; c++) {
+                if (x->children[c] && !fn(static_cast<uint8_t>(c), x->children[c])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+}
+
+template <class Value>
+typename AdaptiveRadixTree<Value>::Node *
+AdaptiveRadixTree<Value>::lastChild(Inner *n)
+{
+    switch (n->type) {
+        case kNode4:
+        case kNode16: {
+            uint8_t *keys;
+            Node **children;
+            sortedArrays(n, keys, children);
+            return children[n->num - 1];
+        }
+        case kNode48: {
+            Node48 *x = static_cast<Node48 *>(n);
+            for (int c = 255; ; c--) {
+                if (x->index[c]) {
+                    return x->children[x->index[c] - 1];
+                }
+            }
+        }
+        default: {
+            Node256 *x = static_cast<Node256 *>(n);
+            for (int c = 255; ; c--) {
+                if (x->children[c]) {
+                    return x->children[c];
+                }
+            }
+        }
+    }
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::copyHeader(Inner *to, Inner *from)
+{
+    to->num = from->num;
+    to->count = from->count;
+    to->prefix.swap(from->prefix);
+    to->terminal = from->terminal;
+}
+
+/**
+ * @brief 结点已满时换成容量更大的结点
+ */
+template <class Value>
+void AdaptiveRadixTree<Value>::grow(Node *&ref)
+{
+    Inner *n = static_cast<Inner *>(ref);
+    Inner *bigger;
+
+    if (n->type == kNode4) {
+        Node4 *x = static_cast<Node4 *>(n);
+        Node16 *y = new Node16();
+        memcpy(y->keys, x->keys, x->num);
+        memcpy(y->children, x->children, x->num * sizeof(Node *));
+        bigger = y;
+    } else if (n->type == kNode16) {
+        Node16 *x = static_cast<Node16 *>(n);
+        Node48 *y = new Node48();
+        for (int i = 0; i < x->num; i++) {
+            y->index[x->keys[i]] = static_cast<uint8_t>(i + 1);
+            y->children[i] = x->children[i];
+        }
+        bigger = y;
+    } else {
+        Node48 *x = static_cast<Node48 *>(n);
+        Node256 *y = new Node256();
+        for (int c = 0; c < 256; c++) {
+            if (x->index[c]) {
+                y->children[c] = x->children[x->index[c] - 1];
+            }
+        }
+        bigger = y;
+    }
+
+    copyHeader(bigger, n);
+    freeNode(n);
+    ref = bigger;
+}
+
+/**
+ * @brief 子结点过少时换成容量更小的结点，阈值低于扩张的阈值，避免反复扩张和收缩
+ */
+template <class Value>
+void AdaptiveRadixTree<Value>::shrink(Node *&ref)
+{
+    Inner *n = static_cast<Inner *>(ref);
+    Inner *smaller;
+
+    if (n->type == kNode16) {
+        Node16 *x = static_cast<Node16 *>(n);
+        Node4 *y = new Node4();
+        memcpy(y->keys, x->keys, x->num);
+        memcpy(y->children, x->children, x->num * sizeof(Node *));
+        smaller = y;
+    } else if (n->type == kNode48) {
+        Node16 *y = new Node16();
+        int i = 0;
+        forEachChild(n, [y, &i](uint8_t c, Node *child) {
+            y->keys[i] = c;
+            y->children[i++] = child;
+            return true;
+        });
+        smaller = y;
+    } else {
+        Node48 *y = new Node48();
+        int i = 0;
+        forEachChild(n, [y, &i](uint8_t c, Node *child) {
+            y->index[c] = static_cast<uint8_t>(i + 1);
+            y->children[i++] = child;
+            return true;
+        });
+        smaller = y;
+    }
+
+    copyHeader(smaller, n);
+    freeNode(n);
+    ref = smaller;
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::addChild(Node *&ref, uint8_t c, Node *child)
+{
+    Inner *n = static_cast<Inner *>(ref);
+
+    switch (n->type) {
+        case kNode4:
+        case kNode16: {
+            if (n->num == (n->type == kNode4 ? 4 : 16)) {
+                grow(ref);
+                addChild(ref, c, child);
+                return;
+            }
+
+            uint8_t *keys;
+            Node **children;
+            sortedArrays(n, keys, children);
+
+            int i = n->num;
+            while (i > 0 && keys[i - 1] > c) {
+                keys[i] = keys[i - 1];
+                children[i] = children[i - 1];
+                i--;
+            }
+            keys[i] = c;
+            children[i] = child;
+            break;
+        }
+        case kNode48: {
+            if (n->num == 48) {
+                grow(ref);
+                addChild(ref, c, child);
+                return;
+            }
+
+            Node48 *x = static_cast<Node48 *>(n);
+            x->children[x->num] = child;
+            x->index[c] = static_cast<uint8_t>(x->num + 1);
+            break;
+        }
+        default:
+            static_cast<Node256 *>(n)->children[c] = child;
+            break;
+    }
+
+    n->num++;
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::removeChild(Node *&ref, uint8_t c)
+{
+    Inner *n = static_cast<Inner *>(ref);
+
+    switch (n->type) {
+        case kNode4:
+        case kNode16: {
+            uint8_t *keys;
+            Node **children;
+            sortedArrays(n, keys, children);
+
+            int i = 0;
+            while (keys[i] != c) {
+                i++;
+            }
+            for (; i + 1 < n->num; i++) {
+                keys[i] = keys[i + 1];
+                children[i] = children[i + 1];
+            }
+            n->num--;
+
+            if (n->type == kNode16 && n->num <= 3) {
+                shrink(ref);
+            }
+            break;
+        }
+        case kNode48: {
+            // 用最后一个子结点填补空位，保持children紧凑
+            Node48 *x = static_cast<Node48 *>(n);
+            int slot = x->index[c] - 1;
+            int last = x->num - 1;
+            x->index[c] = 0;
+            if (slot != last) {
+                x->children[slot] = x->children[last];
+                for (int b = 0; b < 256; b++) {
+                    if (x->index[b] == last + 1) {
+                        x->index[b] = static_cast<uint8_t>(slot + 1);
+                        break;
+                    }
+                }
+            }
+            x->num--;
+
+            if (x->num <= 12) {
+                shrink(ref);
+            }
+            break;
+        }
+        default:
+            static_cast<Node256 *>(n)->children[c] = nullptr;
+            n->num--;
+
+            if (n->num <= 37) {
+                shrink(ref);
+            }
+            break;
+    }
+}
+
+/**
+ * @brief 结点只剩一个键或子结点时用它替换自己，子结点为内部结点时把路径并入它的prefix
+ */
+template <class Value>
+void AdaptiveRadixTree<Value>::collapse(Node *&ref)
+{
+    Inner *n = static_cast<Inner *>(ref);
+    if (n->num + (n->terminal ? 1 : 0) > 1) {
+        return;
+    }
+
+    if (n->num == 0) {
+        ref = n->terminal;
+    } else {
+        uint8_t c = 0;
+        Node *child = nullptr;
+        forEachChild(n, [&c, &child](uint8_t b, Node *x) { c = b; child = x; return false; });
+
+        if (child->type != kLeaf) {
+            Inner *inner = static_cast<Inner *>(child);
+            inner->prefix = n->prefix + static_cast<char>(c) + inner->prefix;
+        }
+        ref = child;
+    }
+
+    freeNode(n);
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::placeLeaf(Inner *n, Leaf *leaf, size_t depth)
+{
+    if (leaf->key.size() == depth) {
+        n->terminal = leaf;
+    } else {
+        Node *ref = n;
+        addChild(ref, byteAt(leaf->key, depth), leaf);
+        assert(ref == n);
+    }
+}
+
+template <class Value>
+Value *AdaptiveRadixTree<Value>::get(const string &key)
+{
+    Node *x = root_;
+    size_t depth = 0;
+
+    while (x != nullptr) {
+        if (x->type == kLeaf) {
+            Leaf *leaf = static_cast<Leaf *>(x);
+            return leaf->key == key ? &leaf->value : nullptr;
+        }
+
+        Inner *n = static_cast<Inner *>(x);
+        if (key.compare(depth, n->prefix.size(), n->prefix) != 0) {
+            return nullptr;
+        }
+        depth += n->prefix.size();
+
+        if (depth == key.size()) {
+            return n->terminal ? &n->terminal->value : nullptr;
+        }
+
+        Node **child = findChild(n, byteAt(key, depth));
+        x = child ? *child : nullptr;
+        depth++;
+    }
+
+    return nullptr;
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::put(const string &key, const Value &val)
+{
+    if (put(root_, key, 0, val)) {
+        count_++;
+    }
+}
+
+/**
+ * @brief 把key插入ref指向的子树，depth之前的字节已经匹配，返回是否新增了键
+ */
+template <class Value>
+bool AdaptiveRadixTree<Value>::put(Node *&ref, const string &key, size_t depth, const Value &val)
+{
+    if (ref == nullptr) {
+        ref = new Leaf(key, val);
+        return true;
+    }
+
+    if (ref->type == kLeaf) {
+        Leaf *leaf = static_cast<Leaf *>(ref);
+        if (leaf->key == key) {
+            leaf->value = val;
+            return false;
+        }
+
+        // 两个键在公共前缀之后分叉
+        size_t p = depth;
+        while (p < key.size() && p < leaf->key.size() && key[p] == leaf->key[p]) {
+            p++;
+        }
+
+        Node4 *n = new Node4();
+        n->prefix = key.substr(depth, p - depth);
+        n->count = 2;
+        placeLeaf(n, leaf, p);
+        placeLeaf(n, new Leaf(key, val), p);
+        ref = n;
+        return true;
+    }
+
+    Inner *n = static_cast<Inner *>(ref);
+    size_t p = prefixMismatch(n, key, depth);
+    if (p < n->prefix.size()) {
+        // 在压缩路径的中间分叉
+        Node4 *parent = new Node4();
+        parent->prefix = n->prefix.substr(0, p);
+        parent->count = n->count + 1;
+
+        uint8_t c = static_cast<uint8_t>(n->prefix[p]);
+        n->prefix.erase(0, p + 1);
+
+        Node *parentRef = parent;
+        addChild(parentRef, c, n);
+        placeLeaf(parent, new Leaf(key, val), depth + p);
+        ref = parent;
+        return true;
+    }
+
+    depth += n->prefix.size();
+    if (depth == key.size()) {
+        if (n->terminal) {
+            n->terminal->value = val;
+            return false;
+        }
+
+        n->terminal = new Leaf(key, val);
+        n->count++;
+        return true;
+    }
+
+    uint8_t c = byteAt(key, depth);
+    Node **child = findChild(n, c);
+    if (child != nullptr) {
+        if (!put(*child, key, depth + 1, val)) {
+            return false;
+        }
+        n->count++;
+        return true;
+    }
+
+    n->count++;
+    addChild(ref, c, new Leaf(key, val));
+    return true;
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::deleteKey(const string &key)
+{
+    if (deleteKey(root_, key, 0)) {
+        count_--;
+    }
+}
+
+/**
+ * @brief 从ref指向的子树中删除key，返回是否删除了键
+ */
+template <class Value>
+bool AdaptiveRadixTree<Value>::deleteKey(Node *&ref, const string &key, size_t depth)
+{
+    if (ref == nullptr) {
+        return false;
+    }
+
+    if (ref->type == kLeaf) {
+        if (static_cast<Leaf *>(ref)->key != key) {
+            return false;
+        }
+        freeNode(ref);
+        ref = nullptr;
+        return true;
+    }
+
+    Inner *n = static_cast<Inner *>(ref);
+    if (key.compare(depth, n->prefix.size(), n->prefix) != 0) {
+        return false;
+    }
+    depth += n->prefix.size();
+
+    if (depth == key.size()) {
+        if (n->terminal == nullptr) {
+            return false;
+        }
+        delete n->terminal;
+        n->terminal = nullptr;
+    } else {
+        uint8_t c = byteAt(key, depth);
+        Node **child = findChild(n, c);
+        if (child == nullptr || !deleteKey(*child, key, depth + 1)) {
+            return false;
+        }
+        if (*child == nullptr) {
+            removeChild(ref, c);
+        }
+    }
+
+    static_cast<Inner *>(ref)->count--;
+    collapse(ref);
+    return true;
+}
+
+template <class Value>
+string AdaptiveRadixTree<Value>::minimum()
+{
+    assert(count_ != 0);
+
+    Node *x = root_;
+    while (x->type != kLeaf) {
+        Inner *n = static_cast<Inner *>(x);
+        if (n->terminal) {
+            return n->terminal->key;
+        }
+        forEachChild(n, [&x](uint8_t, Node *child) { x = child; return false; });
+    }
+    return static_cast<Leaf *>(x)->key;
+}
+
+template <class Value>
+string AdaptiveRadixTree<Value>::maximum()
+{
+    assert(count_ != 0);
+
+    Node *x = root_;
+    while (x->type != kLeaf) {
+        x = lastChild(static_cast<Inner *>(x));
+    }
+    return static_cast<Leaf *>(x)->key;
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::deleteMin()
+{
+    deleteKey(minimum());
+}
+
+template <class Value>
+void AdaptiveRadixTree<Value>::deleteMax()
+{
+    deleteKey(maximum());
+}
+
+/**
+ * 沿key的路径下降，累加路径左侧的子树中键的数量
+ */
+template <class Value>
+int AdaptiveRadixTree<Value>::rank(const string &key)
+{
+    int r = 0;
+    Node *x = root_;
+    size_t depth = 0;
+
+    while (x != nullptr) {
+        if (x->type == kLeaf) {
+            return static_cast<Leaf *>(x)->key < key ? r + 1 : r;
+        }
+
+        Inner *n = static_cast<Inner *>(x);
+        int cmp = key.compare(depth, n->prefix.size(), n->prefix);
+        if (cmp < 0) {
+            return r;
+        }
+        if (cmp > 0) {
+            return r + n->count;
+        }
+
+        depth += n->prefix.size();
+        if (depth == key.size()) {
+            return r;
+        }
+
+        if (n->terminal) {
+            r++;
+        }
+
+        uint8_t c = byteAt(key, depth);
+        x = nullptr;
+        forEachChild(n, [&](uint8_t b, Node *child) {
+            if (b == c) {
+                x = child;
+            }
+            if (b >= c) {
+                return false;
+            }
+            r += nodeCount(child);
+            return true;
+        });
+        depth++;
+    }
+
+    return r;
+}
+
+template <class Value>
+string AdaptiveRadixTree<Value>::select(int k)
+{
+    assert(k >= 0 && k < count_);
+
+    Node *x = root_;
+    while (x->type != kLeaf) {
+        Inner *n = static_cast<Inner *>(x);
+        if (n->terminal) {
+            if (k == 0) {
+                return n->terminal->key;
+            }
+            k--;
+        }
+
+        forEachChild(n, [&x, &k](uint8_t, Node *child) {
+            int cnt = nodeCount(child);
+            if (k < cnt) {
+                x = child;
+                return false;
+            }
+            k -= cnt;
+            return true;
+        });
+    }
+    return static_cast<Leaf *>(x)->key;
+}
+
+template <class Value>
+bool AdaptiveRadixTree<Value>::floor(const string &key, string &result)
+{
+    if (contain(key)) {
+        result = key;
+        return true;
+    }
+
+    int r = rank(key);
+    if (r == 0) {
+        return false;
+    }
+
+    result = select(r - 1);
+    return true;
+}
+
+template <class Value>
+bool AdaptiveRadixTree<Value>::ceiling(const string &key, string &result)
+{
+    int r = rank(key);
+    if (r == count_) {
+        return false;
+    }
+
+    result = select(r);
+    return true;
+}
+
+template <class Value>
+int AdaptiveRadixTree<Value>::size(const string &lo, const string &hi)
+{
+    if (hi < lo) {
+        return 0;
+    }
+    return rank(hi) - rank(lo) + (contain(hi) ? 1 : 0);
+}
+
+template <class Value>
+template <class Func>
+void AdaptiveRadixTree<Value>::forEach(const string &lo, const string &hi, Func fn)
+{
+    string path;
+    forEach(root_, path, lo, hi, fn);
+}
+
+/**
+ * @brief path为x之前的路径，子树中的键都以path + prefix开头，
+ * 整棵子树小于lo时跳过，大于hi时停止遍历，返回false表示已经越过hi
+ */
+template <class Value>
+template <class Func>
+bool AdaptiveRadixTree<Value>::forEach(Node *x, string &path, const string &lo, const string &hi, Func &fn)
+{
+    if (x == nullptr) {
+        return true;
+    }
+
+    if (x->type == kLeaf) {
+        Leaf *leaf = static_cast<Leaf *>(x);
+        if (hi < leaf->key) {
+            return false;
+        }
+        if (!(leaf->key < lo)) {
+            fn(leaf->key, leaf->value);
+        }
+        return true;
+    }
+
+    Inner *n = static_cast<Inner *>(x);
+    size_t depth = path.size();
+    path += n->prefix;
+
+    bool more = true;
+    if (hi < path) {
+        more = false;
+    } else if (path < lo && lo.compare(0, path.size(), path) != 0) {
+        more = true;
+    } else {
+        if (n->terminal && !(path < lo)) {
+            fn(n->terminal->key, n->terminal->value);
+        }
+
+        more = forEachChild(n, [&](uint8_t c, Node *child) {
+            path.push_back(static_cast<char>(c));
+            bool next = forEach(child, path, lo, hi, fn);
+            path.pop_back();
+            return next;
+        });
+    }
+
+    path.resize(depth);
+    return more;
+}
+
+#endif
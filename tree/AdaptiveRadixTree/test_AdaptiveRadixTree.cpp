@@ -0,0 +1,47 @@
+#include "AdaptiveRadixTree.h"
+
+#include <iostream>
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    AdaptiveRadixTree<int> art;
+
+    const char *urls[] = {
+        "http://example.com/",
+        "http://example.com/index.html",
+        "http://example.com/images/a.png",
+        "http://example.com/images/b.png",
+        "http://example.org/",
+        "https://example.com/",
+    };
+    int n = sizeof(urls) / sizeof(urls[0]);
+    for (int i = 0; i < n; i++) {
+        art.put(urls[i], i);
+    }
+    cout << "size: " << art.size() << endl;
+
+    art.forEach("http://example.com/", "http://example.com/z", [](const string &key, const int &val) {
+        cout << key << " -> " << val << endl;
+    });
+
+    cout << "MIN: " << art.minimum() << endl;
+    cout << "MAX: " << art.maximum() << endl;
+    cout << "rank(http://example.org/): " << art.rank("http://example.org/") << endl;
+    cout << "select(2): " << art.select(2) << endl;
+
+    string result;
+    if (art.floor("http://example.com/images/c.png", result)) {
+        cout << "floor: " << result << endl;
+    }
+    if (art.ceiling("http://example.com/images/", result)) {
+        cout << "ceiling: " << result << endl;
+    }
+
+    art.deleteKey("http://example.com/images/a.png");
+    art.deleteMin();
+    cout << "contain(a.png): " << art.contain("http://example.com/images/a.png") << endl;
+    cout << "size: " << art.size() << endl;
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+#ifndef __AGGREGATEAVLTREE_H_
+#define __AGGREGATEAVLTREE_H_
+
+#include <limits>
+#include "../AVLTree/AVLTree.h"
+using namespace std;
+
+/**
+ * 聚合策略(幺半群)需要提供
+ * 1. value_type: 聚合值的类型
+ * 2. static value_type identity(): 单位元，combine(identity(), a) == combine(a, identity()) == a
+ * 3. static value_type lift(const Key &key, const Value &value): 单个键值对的聚合值
+ * 4. static value_type combine(const value_type &a, const value_type &b): 满足结合律，
+ *    a总是对应较小的键，因此不要求满足交换律
+ */
+template <class Key, class Value>
+struct AVLSumAggregate {
+    using value_type = Value;
+    static value_type identity() { return Value(); }
+    static value_type lift(const Key &, const Value &value) { return value; }
+    static value_type combine(const value_type &a, const value_type &b) { return a + b; }
+};
+
+template <class Key, class Value>
+struct AVLCountAggregate {
+    using value_type = int;
+    static value_type identity() { return 0; }
+    static value_type lift(const Key &, const Value &) { return 1; }
+    static value_type combine(const value_type &a, const value_type &b) { return a + b; }
+};
+
+template <class Key, class Value>
+struct AVLMinAggregate {
+    using value_type = Value;
+    static value_type identity() { return numeric_limits<Value>::max(); }
+    static value_type lift(const Key &, const Value &value) { return value; }
+    static value_type combine(const value_type &a, const value_type &b) { return b < a ? b : a; }
+};
+
+template <class Key, class Value>
+struct AVLMaxAggregate {
+    using value_type = Value;
+    static value_type identity() { return numeric_limits<Value>::lowest(); }
+    static value_type lift(const Key &, const Value &value) { return value; }
+    static value_type combine(const value_type &a, const value_type &b) { return a < b ? b : a; }
+};
+
+/**
+ * 每个结点缓存子树按键升序combine的聚合值，由AVLTree在结构变化和值更新时维护
+ */
+template <class Monoid>
+struct AVLAggregateUpdate {
+    struct metadata {
+        typename Monoid::value_type agg;
+    };
+
+    template <class Node>
+    static void update(Node *x) {
+        x->agg = Monoid::lift(x->key, x->value);
+        if (x->left != nullptr) {
+            x->agg = Monoid::combine(x->left->agg, x->agg);
+        }
+        if (x->right != nullptr) {
+            x->agg = Monoid::combine(x->agg, x->right->agg);
+        }
+    }
+};
+
+/**
+ * 支持区间聚合查询的AVL树
+ * aggregate(lo, hi)先找到lo和hi的查找路径分叉的结点，
+ * 再沿两条路径分别累加整棵落在区间内的子树的缓存值，只访问O(log n)个结点
+ *
+ * 不变式：每个结点的agg与子树中的键值对一致。值在树外被原地修改时agg不会更新，
+ * 因此不公开继承AVLTree，只开放经过AVLAggregateUpdate维护的修改(put、compute、upsert、删除)，
+ * 读取只给出const的值；get/put返回的可写指针、multiGet、kNearest、floorMany、parallelForEach等不开放
+ */
+template <class Key, class Value, class Monoid>
+class AggregateAVLTree : protected AVLTree<Key, Value, AVLAggregateUpdate<Monoid>> {
+public:
+    using MyAVLTree = AVLTree<Key, Value, AVLAggregateUpdate<Monoid>>;
+    using MyAVLTreeNode = typename MyAVLTree::MyAVLTreeNode;
+    using AggValue = typename Monoid::value_type;
+
+public:
+    using MyAVLTree::size;
+    using MyAVLTree::isEmpty;
+    using MyAVLTree::contain;
+    using MyAVLTree::floor;
+    using MyAVLTree::ceiling;
+    using MyAVLTree::upsert;
+    using MyAVLTree::deleteMin;
+    using MyAVLTree::deleteMax;
+    using MyAVLTree::popMin;
+    using MyAVLTree::popMax;
+    using MyAVLTree::deleteRange;
+    using MyAVLTree::clear;
+    using MyAVLTree::memoryUsage;
+    using MyAVLTree::shrink;
+
+    Key minimum() { return MyAVLTree::minimum(); }
+    Key maximum() { return MyAVLTree::maximum(); }
+
+    const Value *get(const Key &key) { return MyAVLTree::get(key); }
+    void put(const Key &key, const Value &val) { MyAVLTree::put(key, val); }
+    void deleteKey(const Key &key) { MyAVLTree::deleteKey(key); }
+
+    /* 同AVLTree::compute，返回前沿路径更新agg */
+    template <class Func>
+    bool compute(const Key &key, Func fn) { return MyAVLTree::compute(key, fn); }
+
+    /* 按键的升序访问[lo, hi]之间的所有键值对，fn(key, const value) */
+    template <class Func>
+    void forEach(const Key &lo, const Key &hi, Func fn) {
+        MyAVLTree::forEach(lo, hi, [&fn](const Key &key, const Value &value) { fn(key, value); });
+    }
+
+    /* 全表的聚合值 */
+    AggValue aggregate() { return aggOf(this->root_); }
+
+    /* [lo, hi]之间所有键值对的聚合值 */
+    AggValue aggregate(const Key &lo, const Key &hi);
+
+private:
+    AggValue aggOf(const MyAVLTreeNode *x) { return x != nullptr ? x->agg : Monoid::identity(); }
+
+    AggValue aggregateFrom(const MyAVLTreeNode *x, const Key &lo);
+    AggValue aggregateTo(const MyAVLTreeNode *x, const Key &hi);
+};
+
+template <class Key, class Value, class Monoid>
+typename AggregateAVLTree<Key, Value, Monoid>::AggValue
+AggregateAVLTree<Key, Value, Monoid>::aggregate(const Key &lo, const Key &hi)
+{
+    const MyAVLTreeNode *x = this->root_;
+    while (x != nullptr) {
+        if (x->key < lo) {
+            x = x->right;
+        } else if (hi < x->key) {
+            x = x->left;
+        } else {
+            break; // lo <= x->key <= hi，两条路径在x处分叉
+        }
+    }
+
+    if (x == nullptr) {
+        return Monoid::identity();
+    }
+
+    AggValue result = aggregateFrom(x->left, lo);
+    result = Monoid::combine(result, Monoid::lift(x->key, x->value));
+    return Monoid::combine(result, aggregateTo(x->right, hi));
+}
+
+/**
+ * @brief 子树x中所有>=lo的键的聚合值
+ */
+template <class Key, class Value, class Monoid>
+typename AggregateAVLTree<Key, Value, Monoid>::AggValue
+AggregateAVLTree<Key, Value, Monoid>::aggregateFrom(const MyAVLTreeNode *x, const Key &lo)
+{
+    if (x == nullptr) {
+        return Monoid::identity();
+    }
+
+    if (x->key < lo) {
+        return aggregateFrom(x->right, lo);
+    }
+
+    AggValue result = aggregateFrom(x->left, lo);
+    result = Monoid::combine(result, Monoid::lift(x->key, x->value));
+    return Monoid::combine(result, aggOf(x->right));
+}
+
+/**
+ * @brief 子树x中所有<=hi的键的聚合值
+ */
+template <class Key, class Value, class Monoid>
+typename AggregateAVLTree<Key, Value, Monoid>::AggValue
+AggregateAVLTree<Key, Value, Monoid>::aggregateTo(const MyAVLTreeNode *x, const Key &hi)
+{
+    if (x == nullptr) {
+        return Monoid::identity();
+    }
+
+    if (hi < x->key) {
+        return aggregateTo(x->left, hi);
+    }
+
+    AggValue result = Monoid::combine(aggOf(x->left), Monoid::lift(x->key, x->value));
+    return Monoid::combine(result, aggregateTo(x->right, hi));
+}
+
+#endif
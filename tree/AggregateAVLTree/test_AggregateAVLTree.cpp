@@ -0,0 +1,38 @@
+#include "AggregateAVLTree.h"
+
+#include <iostream>
+using namespace std;
+
+template <class Tree>
+void initAggregateTree(Tree &tree)
+{
+    tree.put(10, 100);
+    tree.put(20, 50);
+    tree.put(30, 300);
+    tree.put(40, 20);
+    tree.put(50, 500);
+    tree.put(60, 10);
+}
+
+int main(int argc, char **argv)
+{
+    AggregateAVLTree<int, int, AVLSumAggregate<int, int>> sumTree;
+    AggregateAVLTree<int, int, AVLMaxAggregate<int, int>> maxTree;
+
+    initAggregateTree(sumTree);
+    initAggregateTree(maxTree);
+
+    cout << "sum: " << sumTree.aggregate() << endl;
+    cout << "sum [15, 45]: " << sumTree.aggregate(15, 45) << endl;
+    cout << "max [15, 45]: " << maxTree.aggregate(15, 45) << endl;
+
+    sumTree.deleteKey(30);
+    maxTree.deleteKey(30);
+    cout << "sum [15, 45] after delete 30: " << sumTree.aggregate(15, 45) << endl;
+    cout << "max [15, 45] after delete 30: " << maxTree.aggregate(15, 45) << endl;
+
+    sumTree.put(20, 1);
+    cout << "sum [15, 45] after put(20, 1): " << sumTree.aggregate(15, 45) << endl;
+
+    return 0;
+}
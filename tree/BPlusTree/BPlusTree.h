@@ -0,0 +1,760 @@
+#ifndef __BPLUSTREE_H_
+#define __BPLUSTREE_H_
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include "BufferPool.h"
+using namespace std;
+
+/**
+ * 存放在磁盘上的B+树，通过固定大小的缓冲池访问页，数据量可以远大于内存
+ * 1. 第0页是元信息页，其余每页是一个内部结点或叶子结点
+ * 2. 内部结点: keys[i]是children[i + 1]子树中最小的键，children[i]子树中的键都小于keys[i]
+ * 3. 叶子结点按键的顺序通过prev/next双向链接，范围扫描沿链表进行并预读后续的页
+ * 4. 一次查找只访问从根到叶子的一条路径，I/O次数不超过树高
+ * 删除只从叶子中移除键，不合并结点；rank/select/size(lo, hi)需要沿叶子链表扫描
+ * 键和值按内存布局存入页中，因此必须是trivially copyable的类型
+ * 读页失败(I/O错误或缓冲池的帧全部被pin住)时操作返回false，插入在修改任何页之前就pin住所需的页，
+ * 失败时树保持不变
+ */
+template <class Key, class Value, size_t PageSize = 4096>
+class BPlusTree {
+public:
+    static_assert(is_trivially_copyable<Key>::value, "Key must be trivially copyable");
+    static_assert(is_trivially_copyable<Value>::value, "Value must be trivially copyable");
+
+    explicit BPlusTree(int poolPages = 256);
+    ~BPlusTree();
+
+    BPlusTree(const BPlusTree &) = delete;
+    BPlusTree &operator=(const BPlusTree &) = delete;
+
+public:
+    /* 打开页文件，文件不存在时创建一棵空树 */
+    bool open(const string &path);
+    bool close();
+    bool flush();
+
+    int size() { return static_cast<int>(meta().count); }
+    bool isEmpty() { return size() == 0; }
+    const BufferPool::Stats &stats() { return pool_.stats(); }
+
+    bool contain(const Key &key);
+    bool get(const Key &key, Value &val);
+    bool put(const Key &key, const Value &val);
+    bool deleteKey(const Key &key);
+
+    /* 读页失败时返回Key() */
+    Key minimum();
+    Key maximum();
+
+    bool deleteMin() { Key key = Key(); return firstKey(key) && deleteKey(key); }
+    bool deleteMax() { Key key = Key(); return lastKey(key) && deleteKey(key); }
+
+    /* 小于等于key的最大键，不存在时返回false */
+    bool floor(const Key &key, Key &result);
+
+    /* 大于等于key的最小键，不存在时返回false */
+    bool ceiling(const Key &key, Key &result);
+
+    /* 小于key的键的数量，读页失败时返回-1 */
+    int rank(const Key &key);
+
+    /* 排名为k(从0开始)的键，读页失败时返回Key() */
+    Key select(int k);
+
+    /* [lo, hi]之间键的数量，读页失败时返回-1 */
+    int size(const Key &lo, const Key &hi);
+
+    /* 按键的升序访问[lo, hi]之间的所有键值对，fn(key, value)；读页失败时中途停止并返回false */
+    template <class Func>
+    bool forEach(const Key &lo, const Key &hi, Func fn);
+
+private:
+    static const uint32_t kMagic = 0x42504c54; // "BPLT"
+    static const uint32_t kNullPage = 0;       // 第0页是元信息页，不会作为结点
+    static const int kReadAheadPages = 8;
+
+    struct PageHeader {
+        uint16_t isLeaf;
+        uint16_t count;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    static const int kLeafCapacity = (PageSize - 64) / (sizeof(Key) + sizeof(Value));
+    static const int kInnerCapacity = (PageSize - 64) / (sizeof(Key) + sizeof(uint32_t));
+
+    struct LeafPage {
+        PageHeader header;
+        Key keys[kLeafCapacity];
+        Value values[kLeafCapacity];
+    };
+
+    struct InnerPage {
+        PageHeader header;
+        Key keys[kInnerCapacity];
+        uint32_t children[kInnerCapacity + 1];
+    };
+
+    struct MetaPage {
+        uint32_t magic;
+        uint32_t root;
+        uint32_t firstLeaf;
+        uint32_t lastLeaf;
+        uint64_t count;
+    };
+
+    static_assert(kLeafCapacity >= 4 && kInnerCapacity >= 4, "PageSize is too small");
+    static_assert(sizeof(LeafPage) <= PageSize && sizeof(InnerPage) <= PageSize, "page overflow");
+
+    /**
+     * pin住一个页，离开作用域时unpin；fetchPage/newPage失败时valid()为false，不能访问页的内容
+     */
+    class PageGuard {
+    public:
+        PageGuard(BufferPool &pool, uint32_t pageId) : pool_(&pool), pageId_(pageId), dirty_(false) {
+            data_ = pool.fetchPage(pageId);
+        }
+        explicit PageGuard(BufferPool &pool) : pool_(&pool), pageId_(kNullPage), dirty_(true) {
+            data_ = pool.newPage(pageId_);
+        }
+        ~PageGuard() { if (data_ != nullptr) pool_->unpinPage(pageId_, dirty_); }
+
+        PageGuard(const PageGuard &) = delete;
+        PageGuard &operator=(const PageGuard &) = delete;
+
+        bool valid() const { return data_ != nullptr; }
+        uint32_t id() const { return pageId_; }
+        void markDirty() { dirty_ = true; }
+
+        PageHeader *header() { return reinterpret_cast<PageHeader *>(data_); }
+        LeafPage *leaf() { return reinterpret_cast<LeafPage *>(data_); }
+        InnerPage *inner() { return reinterpret_cast<InnerPage *>(data_); }
+        MetaPage *meta() { return reinterpret_cast<MetaPage *>(data_); }
+
+    private:
+        BufferPool *pool_;
+        uint32_t pageId_;
+        char *data_;
+        bool dirty_;
+    };
+
+    MetaPage &meta() { return metaCopy_; }
+
+    uint32_t findLeaf(const Key &key);
+    bool firstKey(Key &key);
+    bool lastKey(Key &key);
+    bool insert(uint32_t pageId, const Key &key, const Value &val);
+    bool needSplit(PageGuard &page, const Key &key);
+    bool split(PageGuard &page, Key &splitKey, uint32_t &splitPage);
+    bool splitLeaf(PageGuard &page, Key &splitKey, uint32_t &splitPage);
+    bool splitInner(PageGuard &page, Key &splitKey, uint32_t &splitPage);
+
+    static int lowerBound(const Key *keys, int n, const Key &key);
+    static int upperBound(const Key *keys, int n, const Key &key);
+
+private:
+    BufferPool pool_;
+    MetaPage metaCopy_; // 元信息页的内存副本，flush时写回第0页
+    bool opened_;
+};
+
+template <class Key, class Value, size_t PageSize>
+BPlusTree<Key, Value, PageSize>::BPlusTree(int poolPages)
+    : pool_(PageSize, max(poolPages, 16))
+{
+    metaCopy_ = MetaPage{kMagic, kNullPage, kNullPage, kNullPage, 0};
+    opened_ = false;
+}
+
+template <class Key, class Value, size_t PageSize>
+BPlusTree<Key, Value, PageSize>::~BPlusTree()
+{
+    close();
+}
+
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::open(const string &path)
+{
+    assert(!opened_);
+    if (!pool_.open(path)) {
+        return false;
+    }
+
+    if (pool_.pageCount() == 0) {
+        PageGuard metaPage(pool_);
+        PageGuard rootPage(pool_);
+        if (!metaPage.valid() || !rootPage.valid()) {
+            return false;
+        }
+        assert(metaPage.id() == 0);
+
+        rootPage.header()->isLeaf = 1;
+        metaCopy_ = MetaPage{kMagic, rootPage.id(), rootPage.id(), rootPage.id(), 0};
+        *metaPage.meta() = metaCopy_;
+    } else {
+        PageGuard metaPage(pool_, 0);
+        if (!metaPage.valid() || metaPage.meta()->magic != kMagic) {
+            return false;
+        }
+        metaCopy_ = *metaPage.meta();
+    }
+
+    opened_ = true;
+    return true;
+}
+
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::flush()
+{
+    if (!opened_) {
+        return false;
+    }
+
+    {
+        PageGuard metaPage(pool_, 0);
+        if (!metaPage.valid()) {
+            return false;
+        }
+        *metaPage.meta() = metaCopy_;
+        metaPage.markDirty();
+    }
+
+    return pool_.flushAll();
+}
+
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::close()
+{
+    if (!opened_) {
+        return true;
+    }
+
+    bool ok = flush();
+    opened_ = false;
+    return pool_.close() && ok;
+}
+
+template <class Key, class Value, size_t PageSize>
+int BPlusTree<Key, Value, PageSize>::lowerBound(const Key *keys, int n, const Key &key)
+{
+    return static_cast<int>(lower_bound(keys, keys + n, key) - keys);
+}
+
+template <class Key, class Value, size_t PageSize>
+int BPlusTree<Key, Value, PageSize>::upperBound(const Key *keys, int n, const Key &key)
+{
+    return static_cast<int>(upper_bound(keys, keys + n, key) - keys);
+}
+
+/**
+ * @brief 从根走到key所在的叶子，每层只pin一个页；读页失败时返回kNullPage
+ */
+template <class Key, class Value, size_t PageSize>
+uint32_t BPlusTree<Key, Value, PageSize>::findLeaf(const Key &key)
+{
+    uint32_t pageId = meta().root;
+    for (;;) {
+        PageGuard page(pool_, pageId);
+        if (!page.valid()) {
+            return kNullPage;
+        }
+        if (page.header()->isLeaf) {
+            return pageId;
+        }
+
+        InnerPage *inner = page.inner();
+        pageId = inner->children[upperBound(inner->keys, inner->header.count, key)];
+    }
+}
+
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::get(const Key &key, Value &val)
+{
+    uint32_t leafId = findLeaf(key);
+    if (leafId == kNullPage) {
+        return false;
+    }
+
+    PageGuard page(pool_, leafId);
+    if (!page.valid()) {
+        return false;
+    }
+    LeafPage *leaf = page.leaf();
+
+    int i = lowerBound(leaf->keys, leaf->header.count, key);
+    if (i == leaf->header.count || key < leaf->keys[i]) {
+        return false;
+    }
+
+    val = leaf->values[i];
+    return true;
+}
+
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::contain(const Key &key)
+{
+    Value val;
+    return get(key, val);
+}
+
+/**
+ * 自顶向下插入：下降之前先分裂已满的子结点，分裂时父结点一定还有空位，
+ * 每次分裂只涉及已经pin住的页，不会出现子结点分裂成功而父结点无法容纳的情况
+ */
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::put(const Key &key, const Value &val)
+{
+    {
+        PageGuard root(pool_, meta().root);
+        if (!root.valid()) {
+            return false;
+        }
+
+        if (needSplit(root, key)) {
+            // 先分配新的根，分裂失败时它只是文件中一个没有被引用的空页
+            PageGuard newRoot(pool_);
+            Key splitKey;
+            uint32_t splitPage;
+            if (!newRoot.valid() || !split(root, splitKey, splitPage)) {
+                return false;
+            }
+
+            // 根结点分裂，树长高一层
+            InnerPage *inner = newRoot.inner();
+            inner->header.isLeaf = 0;
+            inner->header.count = 1;
+            inner->keys[0] = splitKey;
+            inner->children[0] = root.id();
+            inner->children[1] = splitPage;
+
+            meta().root = newRoot.id();
+        }
+    }
+
+    return insert(meta().root, key, val);
+}
+
+/**
+ * @brief 在以pageId为根的子树中插入，调用者保证这个结点不需要分裂
+ */
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::insert(uint32_t pageId, const Key &key, const Value &val)
+{
+    PageGuard page(pool_, pageId);
+    if (!page.valid()) {
+        return false;
+    }
+
+    if (page.header()->isLeaf) {
+        LeafPage *leaf = page.leaf();
+        int n = leaf->header.count;
+        int i = lowerBound(leaf->keys, n, key);
+
+        page.markDirty();
+        if (i < n && !(key < leaf->keys[i])) {
+            leaf->values[i] = val;
+            return true;
+        }
+
+        assert(n < kLeafCapacity);
+        copy_backward(leaf->keys + i, leaf->keys + n, leaf->keys + n + 1);
+        copy_backward(leaf->values + i, leaf->values + n, leaf->values + n + 1);
+        leaf->keys[i] = key;
+        leaf->values[i] = val;
+        leaf->header.count++;
+
+        meta().count++;
+        return true;
+    }
+
+    InnerPage *inner = page.inner();
+    int i = upperBound(inner->keys, inner->header.count, key);
+    uint32_t childId = inner->children[i];
+
+    {
+        PageGuard child(pool_, childId);
+        if (!child.valid()) {
+            return false;
+        }
+
+        if (needSplit(child, key)) {
+            Key splitKey;
+            uint32_t splitPage;
+            if (!split(child, splitKey, splitPage)) {
+                return false;
+            }
+
+            // 把(splitKey, splitPage)插入到第i个位置
+            int n = inner->header.count;
+            assert(n < kInnerCapacity);
+            copy_backward(inner->keys + i, inner->keys + n, inner->keys + n + 1);
+            copy_backward(inner->children + i + 1, inner->children + n + 1, inner->children + n + 2);
+            inner->keys[i] = splitKey;
+            inner->children[i + 1] = splitPage;
+            inner->header.count++;
+            page.markDirty();
+
+            if (!(key < splitKey)) {
+                childId = splitPage;
+            }
+        }
+    }
+
+    return insert(childId, key, val);
+}
+
+/**
+ * @brief 已满的内部结点，或者已满且不包含key的叶子，插入前需要分裂
+ */
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::needSplit(PageGuard &page, const Key &key)
+{
+    if (!page.header()->isLeaf) {
+        return page.header()->count == kInnerCapacity;
+    }
+
+    LeafPage *leaf = page.leaf();
+    int n = leaf->header.count;
+    if (n < kLeafCapacity) {
+        return false;
+    }
+
+    int i = lowerBound(leaf->keys, n, key);
+    return i == n || key < leaf->keys[i];
+}
+
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::split(PageGuard &page, Key &splitKey, uint32_t &splitPage)
+{
+    return page.header()->isLeaf ? splitLeaf(page, splitKey, splitPage)
+                                 : splitInner(page, splitKey, splitPage);
+}
+
+/**
+ * @brief 把叶子的后一半移动到新的叶子中，并接入叶子链表；先pin住后继叶子和新页，失败时不做任何修改
+ */
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::splitLeaf(PageGuard &page, Key &splitKey, uint32_t &splitPage)
+{
+    LeafPage *leaf = page.leaf();
+    uint32_t nextId = leaf->header.next;
+
+    // 没有后继叶子时pin住的是元信息页，不会修改它
+    PageGuard next(pool_, nextId != kNullPage ? nextId : 0);
+    if (!next.valid()) {
+        return false;
+    }
+    PageGuard right(pool_);
+    if (!right.valid()) {
+        return false;
+    }
+    LeafPage *rightLeaf = right.leaf();
+
+    int n = leaf->header.count;
+    int half = n / 2;
+
+    copy(leaf->keys + half, leaf->keys + n, rightLeaf->keys);
+    copy(leaf->values + half, leaf->values + n, rightLeaf->values);
+    rightLeaf->header.isLeaf = 1;
+    rightLeaf->header.count = static_cast<uint16_t>(n - half);
+    leaf->header.count = static_cast<uint16_t>(half);
+
+    rightLeaf->header.prev = page.id();
+    rightLeaf->header.next = nextId;
+    if (nextId != kNullPage) {
+        next.header()->prev = right.id();
+        next.markDirty();
+    } else {
+        meta().lastLeaf = right.id();
+    }
+    leaf->header.next = right.id();
+    page.markDirty();
+
+    splitKey = rightLeaf->keys[0];
+    splitPage = right.id();
+    return true;
+}
+
+/**
+ * @brief 内部结点的中间键上移，右半部分移动到新的结点中
+ */
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::splitInner(PageGuard &page, Key &splitKey, uint32_t &splitPage)
+{
+    InnerPage *inner = page.inner();
+    PageGuard right(pool_);
+    if (!right.valid()) {
+        return false;
+    }
+    InnerPage *rightInner = right.inner();
+
+    int n = inner->header.count;
+    int mid = n / 2;
+
+    copy(inner->keys + mid + 1, inner->keys + n, rightInner->keys);
+    copy(inner->children + mid + 1, inner->children + n + 1, rightInner->children);
+    rightInner->header.isLeaf = 0;
+    rightInner->header.count = static_cast<uint16_t>(n - mid - 1);
+    inner->header.count = static_cast<uint16_t>(mid);
+    page.markDirty();
+
+    splitKey = inner->keys[mid];
+    splitPage = right.id();
+    return true;
+}
+
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::deleteKey(const Key &key)
+{
+    uint32_t leafId = findLeaf(key);
+    if (leafId == kNullPage) {
+        return false;
+    }
+
+    PageGuard page(pool_, leafId);
+    if (!page.valid()) {
+        return false;
+    }
+    LeafPage *leaf = page.leaf();
+
+    int n = leaf->header.count;
+    int i = lowerBound(leaf->keys, n, key);
+    if (i == n || key < leaf->keys[i]) {
+        return false;
+    }
+
+    copy(leaf->keys + i + 1, leaf->keys + n, leaf->keys + i);
+    copy(leaf->values + i + 1, leaf->values + n, leaf->values + i);
+    leaf->header.count--;
+    page.markDirty();
+
+    meta().count--;
+    return true;
+}
+
+/**
+ * @brief 删除不合并结点，叶子可能为空，需要沿链表跳过空的叶子；树为空或读页失败时返回false
+ */
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::firstKey(Key &key)
+{
+    uint32_t pageId = isEmpty() ? kNullPage : meta().firstLeaf;
+    while (pageId != kNullPage) {
+        PageGuard page(pool_, pageId);
+        if (!page.valid()) {
+            return false;
+        }
+        if (page.header()->count > 0) {
+            key = page.leaf()->keys[0];
+            return true;
+        }
+        pageId = page.header()->next;
+    }
+
+    return false;
+}
+
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::lastKey(Key &key)
+{
+    uint32_t pageId = isEmpty() ? kNullPage : meta().lastLeaf;
+    while (pageId != kNullPage) {
+        PageGuard page(pool_, pageId);
+        if (!page.valid()) {
+            return false;
+        }
+        int n = page.header()->count;
+        if (n > 0) {
+            key = page.leaf()->keys[n - 1];
+            return true;
+        }
+        pageId = page.header()->prev;
+    }
+
+    return false;
+}
+
+template <class Key, class Value, size_t PageSize>
+Key BPlusTree<Key, Value, PageSize>::minimum()
+{
+    assert(!isEmpty());
+
+    Key key = Key();
+    firstKey(key);
+    return key;
+}
+
+template <class Key, class Value, size_t PageSize>
+Key BPlusTree<Key, Value, PageSize>::maximum()
+{
+    assert(!isEmpty());
+
+    Key key = Key();
+    lastKey(key);
+    return key;
+}
+
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::floor(const Key &key, Key &result)
+{
+    uint32_t pageId = findLeaf(key);
+    bool first = true;
+
+    while (pageId != kNullPage) {
+        PageGuard page(pool_, pageId);
+        if (!page.valid()) {
+            return false;
+        }
+        LeafPage *leaf = page.leaf();
+
+        int i = first ? upperBound(leaf->keys, leaf->header.count, key) : leaf->header.count;
+        if (i > 0) {
+            result = leaf->keys[i - 1];
+            return true;
+        }
+
+        pageId = leaf->header.prev;
+        first = false;
+    }
+
+    return false;
+}
+
+template <class Key, class Value, size_t PageSize>
+bool BPlusTree<Key, Value, PageSize>::ceiling(const Key &key, Key &result)
+{
+    uint32_t pageId = findLeaf(key);
+    bool first = true;
+
+    while (pageId != kNullPage) {
+        PageGuard page(pool_, pageId);
+        if (!page.valid()) {
+            return false;
+        }
+        LeafPage *leaf = page.leaf();
+
+        int i = first ? lowerBound(leaf->keys, leaf->header.count, key) : 0;
+        if (i < leaf->header.count) {
+            result = leaf->keys[i];
+            return true;
+        }
+
+        pageId = leaf->header.next;
+        first = false;
+    }
+
+    return false;
+}
+
+/**
+ * 从key所在的叶子开始沿链表向后扫描，每进入一段新的页号区间就预读后续的页
+ */
+template <class Key, class Value, size_t PageSize>
+template <class Func>
+bool BPlusTree<Key, Value, PageSize>::forEach(const Key &lo, const Key &hi, Func fn)
+{
+    if (hi < lo) {
+        return true;
+    }
+
+    uint32_t pageId = findLeaf(lo);
+    if (pageId == kNullPage) {
+        return false;
+    }
+    uint32_t prefetched = pageId;
+    bool first = true;
+
+    while (pageId != kNullPage) {
+        if (pageId >= prefetched) {
+            pool_.readAhead(pageId + 1, kReadAheadPages);
+            prefetched = pageId + kReadAheadPages;
+        }
+
+        PageGuard page(pool_, pageId);
+        if (!page.valid()) {
+            return false;
+        }
+        LeafPage *leaf = page.leaf();
+
+        int n = leaf->header.count;
+        int i = first ? lowerBound(leaf->keys, n, lo) : 0;
+        for (; i < n; i++) {
+            if (hi < leaf->keys[i]) {
+                return true;
+            }
+            fn(leaf->keys[i], leaf->values[i]);
+        }
+
+        pageId = leaf->header.next;
+        first = false;
+    }
+
+    return true;
+}
+
+template <class Key, class Value, size_t PageSize>
+int BPlusTree<Key, Value, PageSize>::size(const Key &lo, const Key &hi)
+{
+    int count = 0;
+    if (!forEach(lo, hi, [&count](const Key &, const Value &) { count++; })) {
+        return -1;
+    }
+    return count;
+}
+
+template <class Key, class Value, size_t PageSize>
+int BPlusTree<Key, Value, PageSize>::rank(const Key &key)
+{
+    int count = 0;
+    uint32_t pageId = meta().firstLeaf;
+
+    while (pageId != kNullPage) {
+        PageGuard page(pool_, pageId);
+        if (!page.valid()) {
+            return -1;
+        }
+        LeafPage *leaf = page.leaf();
+
+        int n = leaf->header.count;
+        int i = lowerBound(leaf->keys, n, key);
+        count += i;
+        if (i < n) {
+            break;
+        }
+
+        pageId = leaf->header.next;
+    }
+
+    return count;
+}
+
+template <class Key, class Value, size_t PageSize>
+Key BPlusTree<Key, Value, PageSize>::select(int k)
+{
+    assert(k >= 0 && k < size());
+
+    uint32_t pageId = meta().firstLeaf;
+    while (pageId != kNullPage) {
+        PageGuard page(pool_, pageId);
+        if (!page.valid()) {
+            break;
+        }
+        LeafPage *leaf = page.leaf();
+
+        if (k < leaf->header.count) {
+            return leaf->keys[k];
+        }
+
+        k -= leaf->header.count;
+        pageId = leaf->header.next;
+    }
+
+    return Key();
+}
+
+#endif
@@ -0,0 +1,328 @@
+#ifndef __BUFFERPOOL_H_
+#define __BUFFERPOOL_H_
+
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+/**
+ * 固定大小的页缓冲池
+ * 1. 页文件按pageSize切分，页号从0开始，页号为id的页位于文件偏移id * pageSize处
+ * 2. fetchPage/newPage返回的页被pin住，不会被换出，用完后必须unpinPage
+ * 3. 没有空闲帧时用clock算法选择未被pin的帧换出，脏页换出前写回文件
+ */
+class BufferPool {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t reads;
+        uint64_t writes;
+    };
+
+    BufferPool(size_t pageSize, int frameCount);
+    ~BufferPool();
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+public:
+    bool open(const string &path);
+    bool close();
+
+    size_t pageSize() { return pageSize_; }
+    uint32_t pageCount() { return pageCount_; }
+    const Stats &stats() { return stats_; }
+
+    /* 读取页并pin住，失败(文件未打开、页不存在、没有可换出的帧或读文件失败)返回nullptr */
+    char *fetchPage(uint32_t pageId);
+
+    /* 在文件末尾分配一个清零的新页并pin住 */
+    char *newPage(uint32_t &pageId);
+
+    void unpinPage(uint32_t pageId, bool dirty);
+
+    /* 提示即将顺序读取[pageId, pageId + count)，不在缓冲池中的页交给操作系统异步预读 */
+    void readAhead(uint32_t pageId, int count);
+
+    /* 把所有脏页写回文件，并用fdatasync把文件内容同步到磁盘 */
+    bool flushAll();
+
+private:
+    struct Frame {
+        uint32_t pageId;
+        int pinCount;
+        bool valid;
+        bool dirty;
+        bool referenced;
+    };
+
+    char *frameData(int i) { return &data_[i * pageSize_]; }
+
+    int findVictim();
+    bool readPage(uint32_t pageId, char *buf);
+    bool writePage(uint32_t pageId, const char *buf);
+
+private:
+    size_t pageSize_;
+    vector<char> data_;
+    vector<Frame> frames_;
+    unordered_map<uint32_t, int> pageTable_;
+    int hand_;
+
+    FILE *fp_;
+    uint32_t pageCount_;
+    Stats stats_;
+};
+
+inline BufferPool::BufferPool(size_t pageSize, int frameCount)
+{
+    assert(frameCount > 0);
+
+    pageSize_ = pageSize;
+    data_.resize(pageSize * frameCount);
+    frames_.resize(frameCount, Frame{0, 0, false, false, false});
+    hand_ = 0;
+    fp_ = nullptr;
+    pageCount_ = 0;
+    stats_ = Stats{0, 0, 0, 0};
+}
+
+inline BufferPool::~BufferPool()
+{
+    close();
+}
+
+inline bool BufferPool::open(const string &path)
+{
+    assert(fp_ == nullptr);
+
+    fp_ = fopen(path.c_str(), "r+b");
+    if (fp_ == nullptr) {
+        fp_ = fopen(path.c_str(), "w+b");
+    }
+    if (fp_ == nullptr) {
+        return false;
+    }
+
+    // 页的读写已经按页对齐，不再经过stdio的缓冲
+    setvbuf(fp_, nullptr, _IONBF, 0);
+
+    if (fseek(fp_, 0, SEEK_END) != 0) {
+        return false;
+    }
+    pageCount_ = static_cast<uint32_t>(ftell(fp_) / pageSize_);
+
+    return true;
+}
+
+inline bool BufferPool::close()
+{
+    if (fp_ == nullptr) {
+        return true;
+    }
+
+    bool ok = flushAll();
+    fclose(fp_);
+    fp_ = nullptr;
+
+    pageTable_.clear();
+    for (auto &frame : frames_) {
+        frame = Frame{0, 0, false, false, false};
+    }
+
+    return ok;
+}
+
+inline char *BufferPool::fetchPage(uint32_t pageId)
+{
+    if (fp_ == nullptr || pageId >= pageCount_) {
+        return nullptr;
+    }
+
+    auto it = pageTable_.find(pageId);
+    if (it != pageTable_.end()) {
+        Frame &frame = frames_[it->second];
+        frame.pinCount++;
+        frame.referenced = true;
+        stats_.hits++;
+        return frameData(it->second);
+    }
+
+    stats_.misses++;
+    int i = findVictim();
+    if (i < 0) {
+        return nullptr;
+    }
+
+    if (!readPage(pageId, frameData(i))) {
+        return nullptr;
+    }
+
+    frames_[i] = Frame{pageId, 1, true, false, true};
+    pageTable_[pageId] = i;
+    return frameData(i);
+}
+
+inline char *BufferPool::newPage(uint32_t &pageId)
+{
+    if (fp_ == nullptr) {
+        return nullptr;
+    }
+
+    int i = findVictim();
+    if (i < 0) {
+        return nullptr;
+    }
+
+    pageId = pageCount_++;
+    memset(frameData(i), 0, pageSize_);
+
+    frames_[i] = Frame{pageId, 1, true, true, true};
+    pageTable_[pageId] = i;
+    return frameData(i);
+}
+
+inline void BufferPool::unpinPage(uint32_t pageId, bool dirty)
+{
+    auto it = pageTable_.find(pageId);
+    assert(it != pageTable_.end());
+
+    Frame &frame = frames_[it->second];
+    assert(frame.pinCount > 0);
+
+    frame.pinCount--;
+    frame.dirty = frame.dirty || dirty;
+}
+
+inline void BufferPool::readAhead(uint32_t pageId, int count)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    uint32_t first = pageId;
+    uint32_t last = min(pageCount_, pageId + static_cast<uint32_t>(count));
+
+    while (first < last) {
+        while (first < last && pageTable_.count(first) != 0) {
+            first++;
+        }
+
+        uint32_t end = first;
+        while (end < last && pageTable_.count(end) == 0) {
+            end++;
+        }
+
+        if (first < end) {
+            posix_fadvise(fileno(fp_), static_cast<off_t>(first) * pageSize_,
+                          static_cast<off_t>(end - first) * pageSize_, POSIX_FADV_WILLNEED);
+        }
+        first = end;
+    }
+#else
+    (void)pageId;
+    (void)count;
+#endif
+}
+
+inline bool BufferPool::flushAll()
+{
+    if (fp_ == nullptr) {
+        return false;
+    }
+
+    for (size_t i = 0; i < frames_.size(); i++) {
+        Frame &frame = frames_[i];
+        if (frame.valid && frame.dirty) {
+            if (!writePage(frame.pageId, frameData(static_cast<int>(i)))) {
+                return false;
+            }
+            frame.dirty = false;
+        }
+    }
+
+    if (fflush(fp_) != 0) {
+        return false;
+    }
+
+#ifdef _WIN32
+    return _commit(_fileno(fp_)) == 0;
+#else
+    return fdatasync(fileno(fp_)) == 0;
+#endif
+}
+
+/**
+ * clock算法：指针扫过的帧若referenced为true则清零并跳过，否则选为换出的帧；
+ * 所有帧都被pin住时返回-1
+ */
+inline int BufferPool::findVictim()
+{
+    int n = static_cast<int>(frames_.size());
+    for (int step = 0; step < 2 * n; step++) {
+        int i = hand_;
+        hand_ = (hand_ + 1) % n;
+
+        Frame &frame = frames_[i];
+        if (!frame.valid) {
+            return i;
+        }
+        if (frame.pinCount > 0) {
+            continue;
+        }
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+
+        if (frame.dirty && !writePage(frame.pageId, frameData(i))) {
+            return -1;
+        }
+
+        pageTable_.erase(frame.pageId);
+        frame.valid = false;
+        return i;
+    }
+
+    return -1;
+}
+
+inline bool BufferPool::readPage(uint32_t pageId, char *buf)
+{
+    stats_.reads++;
+    if (fseek(fp_, static_cast<long>(pageId) * static_cast<long>(pageSize_), SEEK_SET) != 0) {
+        return false;
+    }
+
+    size_t n = fread(buf, 1, pageSize_, fp_);
+    if (n < pageSize_) {
+        // 已分配但还没有写回过的页在文件中是空洞
+        if (ferror(fp_)) {
+            return false;
+        }
+        memset(buf + n, 0, pageSize_ - n);
+    }
+
+    return true;
+}
+
+inline bool BufferPool::writePage(uint32_t pageId, const char *buf)
+{
+    stats_.writes++;
+    if (fseek(fp_, static_cast<long>(pageId) * static_cast<long>(pageSize_), SEEK_SET) != 0) {
+        return false;
+    }
+
+    return fwrite(buf, 1, pageSize_, fp_) == pageSize_;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include "BPlusTree.h"
+
+#include <cstdlib>
+#include <iostream>
+using namespace std;
+
+/* 页文件放在临时目录中，结束时删除 */
+string tempPath(const char *name)
+{
+#ifdef _WIN32
+    const char *tmp = getenv("TEMP");
+#else
+    const char *tmp = getenv("TMPDIR");
+#endif
+    return string(tmp != nullptr ? tmp : "/tmp") + "/" + name;
+}
+
+void initBPlusTree(BPlusTree<int, int> &tree)
+{
+    for (int k = 0; k < 100000; k++) {
+        tree.put(k, k * 2);
+    }
+}
+
+void readBPlusTree(const string &pageFile)
+{
+    BPlusTree<int, int> tree(64);
+    tree.open(pageFile);
+
+    int val = 0;
+    cout << "size: " << tree.size() << endl;
+    cout << "MIN: " << tree.minimum() << endl;
+    cout << "MAX: " << tree.maximum() << endl;
+    cout << "contain(500): " << tree.contain(500) << endl;
+    if (tree.get(12345, val)) {
+        cout << "get(12345): " << val << endl;
+    }
+
+    int key = 0;
+    if (tree.floor(500, key)) {
+        cout << "floor(500): " << key << endl;
+    }
+    if (tree.ceiling(500, key)) {
+        cout << "ceiling(500): " << key << endl;
+    }
+    cout << "rank(1000): " << tree.rank(1000) << endl;
+    cout << "select(10): " << tree.select(10) << endl;
+    cout << "size(1000, 1999): " << tree.size(1000, 1999) << endl;
+
+    tree.forEach(498, 503, [](const int &key, const int &value) {
+        cout << "(" << key << ", " << value << ")" << endl;
+    });
+
+    const BufferPool::Stats &stats = tree.stats();
+    cout << "pool hits: " << stats.hits << ", misses: " << stats.misses << endl;
+}
+
+int main(int argc, char **argv)
+{
+    string pageFile = tempPath("bplustree.db");
+    remove(pageFile.c_str());
+
+    {
+        // 只有64个页的缓冲池，数据远大于缓冲池
+        BPlusTree<int, int> tree(64);
+        tree.open(pageFile);
+
+        initBPlusTree(tree);
+        tree.deleteKey(500);
+        tree.deleteMin();
+        tree.deleteMax();
+    }
+
+    readBPlusTree(pageFile);
+
+    remove(pageFile.c_str());
+    return 0;
+}
@@ -3,33 +3,50 @@
 
 #include <cassert>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <type_traits>
+#include "../tree_filter.h"
+#include "../tree_memory.h"
+#include "../tree_alloc.h"
 using namespace std;
 
 /*
  * 一颗二叉查找树(BST)是一颗二叉树，
  * 其中每个节点都含有一个Comparable的键且每个节点的键都大于其左子树的任意结点的键而小于右子树的任意结点的键
  */
+/**
+ * 替罪羊树模式(enableScapegoat)：结点中不保存任何平衡信息
+ * 1. 插入后若新结点的深度超过log(maxCount) / log(1 / alpha)，沿插入路径向上找到第一个
+ *    子结点的大小超过alpha倍自身大小的祖先(替罪羊)，把以它为根的子树重建成完全平衡的树
+ * 2. 删除后若size() < alpha * maxCount，重建整棵树，maxCount是上一次重建整棵树以来的最大键数
+ * 插入和删除的均摊复杂度为O(log n)，树高始终不超过log(n) / log(1 / alpha) + 1
+ */
 
-template <class Key, class Value>
-struct BtNode {
+/**
+ * OutOfLine为true时值保存在树的ValueArena中，结点只保存对它的引用
+ */
+template <class Key, class Value, bool OutOfLine = false>
+struct BtNode : public NodeValue<Value, OutOfLine> {
     Key key;
-    Value value;
     BtNode *left;
     BtNode *right;
 
-    BtNode(const Key &key, const Value &value) {
+    BtNode(const Key &key, const Value &value, ValueArena<Value> &values)
+        : NodeValue<Value, OutOfLine>(value, values) {
         this->key = key;
-        this->value = value;
         this->left = nullptr;
         this->right = nullptr;
     }
 };
 
-template <class Key, class Value>
+template <class Key, class Value, class ValueLayout = AutoValueLayout<>>
 class BinaryTree 
 {
 public:
-    using MyBtNode = BtNode<Key, Value>;
+    using MyBtNode = BtNode<Key, Value, ValueLayout::template outOfLine<Value>()>;
 
 public:
     BinaryTree();
@@ -39,8 +56,28 @@ public:
     bool isEmpty() { return count_ == 0; }
     bool contain(const Key &key) { return get(key) != nullptr; }
 
-    Value *get(const Key &key) { return get(root_, key); }
-    void put(const Key &key, const Value &val) { root_ = put(root_, key, val); }
+    /* 空树为0，需要遍历整棵树 */
+    int height() { return height(root_); }
+
+    Value *get(const Key &key) {
+        if (filter_ != nullptr && !filter_->mayContain(key)) {
+            return nullptr;
+        }
+        return get(root_, key);
+    }
+    void put(const Key &key, const Value &val) {
+        if (alpha_ > 0) {
+            scapegoatPut(key, val);
+        } else {
+            root_ = put(root_, key, val);
+        }
+        if (filter_ != nullptr && count_ > 2 * static_cast<int>(filter_->capacity())) {
+            rebuildFilter();
+        }
+        if (budget_.enabled()) {
+            budget_.check(memoryUsage());
+        }
+    }
 
     Key minimum() {
         assert(count_ != 0);
@@ -53,15 +90,91 @@ public:
         return maxNode->key;
     }
 
-    void deleteMin() { if (root_ != nullptr) root_ = deleteMin(root_); }
-    void deleteMax() { if (root_ != nullptr) root_ = deleteMax(root_); }
+    /* 小于等于key的最大的键，不存在时返回false */
+    bool floor(const Key &key, Key &result);
 
-    void deleteKey(const Key &key) { root_ = deleteKey(root_, key); }
+    /* 大于等于key的最小的键，不存在时返回false */
+    bool ceiling(const Key &key, Key &result);
+
+    void deleteMin() {
+        if (root_ != nullptr) {
+            filterRemove(minimum(root_)->key);
+            root_ = deleteMin(root_);
+            afterDelete();
+        }
+    }
+    void deleteMax() {
+        if (root_ != nullptr) {
+            filterRemove(maximum(root_)->key);
+            root_ = deleteMax(root_);
+            afterDelete();
+        }
+    }
+
+    void deleteKey(const Key &key) {
+        root_ = deleteKey(root_, key);
+        afterDelete();
+    }
+
+    /**
+     * 删除[lo, hi]之间的所有键，返回删除的个数
+     * 按lo和hi把树分裂成三棵，释放中间一棵，再以左边一棵的最大结点为根连接两边，
+     * 只访问两条分裂路径和被删除的结点，复杂度为O(k + h)，k为删除的个数，h为树高
+     */
+    int deleteRange(const Key &lo, const Key &hi);
+
+    /**
+     * Day-Stout-Warren：先把整棵树右旋成一条只有右子结点的链，再沿链做若干轮左旋压缩，
+     * 线性时间得到高度最小的树，只使用O(1)的额外空间
+     */
+    void rebalance();
+
+    /* 开启替罪羊树模式，alpha在(0.5, 1)之间，越小树越矮、重建越频繁；开启时先重建整棵树 */
+    void enableScapegoat(double alpha = 0.7);
+    void disableScapegoat() { alpha_ = 0; }
+
+    /**
+     * 删除所有结点，不使用递归，退化成链表的树也不会栈溢出
+     * 键和值的析构函数平凡时结点从内存池中按块分配，清空只需释放各个块
+     */
+    void clear();
+
+    /* 开启后clear和析构把释放结点的工作交给后台线程，调用者不等待 */
+    void setDeferredDestruction(bool deferred) {
+        if (deferred) {
+            TreeReclaimer::instance();  // 开启时就启动回收线程，析构时不必再创建
+        }
+        deferred_ = deferred;
+    }
 
     void preOrder() { preOrder(root_); }
     void inOrder() { inOrder(root_); }
     void postOrder() { postOrder(root_); }
 
+    /**
+     * 在get/contain之前挂一个计数布隆过滤器，大部分不存在的键不需要访问结点
+     * 过滤器随put/deleteKey/deleteMin/deleteMax同步更新，键的数量超过容量的2倍时自动重建
+     */
+    template <class Hash = hash<Key>>
+    void enableFilter(int expectedKeys, double fpRate = 0.01);
+    void disableFilter() { filter_.reset(); }
+
+    /* 按max(容量, size())重新生成过滤器，批量修改之后调用 */
+    void rebuildFilter();
+
+    /* 结点、分配器开销和附加结构占用的内存，O(1) */
+    TreeMemoryUsage memoryUsage();
+
+    /* put使占用超出limit字节时调用onExceeded，limit为0表示不设预算 */
+    void setMemoryBudget(size_t limit, TreeMemoryBudget::Callback onExceeded) { budget_.set(limit, onExceeded); }
+
+    /**
+     * 大量删除之后调用：按当前大小重建过滤器，并把分配器中空闲的内存还给操作系统
+     * 内存池或ValueArena中不到一半在使用时，把结点和值搬到新的池和区域中再释放旧的，
+     * 之前get返回的值的指针随之失效
+     */
+    void shrink();
+
 private:
     Value *get(MyBtNode *x, const Key &key);
     MyBtNode* put(MyBtNode *x, const Key &key, const Value &val);
@@ -74,7 +187,37 @@ private:
 
     MyBtNode *deleteKey(MyBtNode *x, const Key &key);
 
-    void destroy(MyBtNode *node);
+    static void split(MyBtNode *x, const Key &key, bool inclusive, MyBtNode *&left, MyBtNode *&right);
+    MyBtNode *join(MyBtNode *left, MyBtNode *right);
+    int releaseRange(MyBtNode *x);
+
+    int height(MyBtNode *x);
+    static int countNodes(MyBtNode *x);
+
+    void scapegoatPut(const Key &key, const Value &val);
+    void afterDelete();
+
+    static MyBtNode *rebuild(MyBtNode *root);
+    static int treeToVine(MyBtNode *&root);
+    static void vineToTree(MyBtNode *&root, int size);
+    static void compress(MyBtNode *&root, int count);
+
+    static const bool kPooled = is_trivially_destructible<MyBtNode>::value;
+    static const bool kOutOfLine = ValueLayout::template outOfLine<Value>();
+
+    MyBtNode *allocNode(const Key &key, const Value &val);
+    void freeNode(MyBtNode *node);
+    void releaseNodes(MyBtNode *root);
+    static void destroy(MyBtNode *node);
+    void relocate(NodePool<MyBtNode> &pool, ValueArena<Value> &values);
+
+    void resetFilter(size_t capacity);
+    void fillFilter(MyBtNode *node);
+    void filterRemove(const Key &key) {
+        if (filter_ != nullptr) {
+            filter_->remove(key);
+        }
+    }
 
     void preOrder(MyBtNode *node);
     void inOrder(MyBtNode *node);
@@ -83,30 +226,115 @@ private:
 private:
     MyBtNode *root_;
     int count_;
+    unique_ptr<CountingBloomFilter<Key>> filter_;
+    TreeMemoryBudget budget_;
+    NodePool<MyBtNode> pool_;
+    ValueArena<Value> values_;
+    bool deferred_;
+
+    double alpha_;          // 为0时不是替罪羊树模式
+    int maxCount_;
+    vector<MyBtNode *> path_; // 替罪羊树插入时记录的路径，复用以免每次分配
 };
 
-template <class Key, class Value>
-BinaryTree<Key, Value>::BinaryTree()
+template <class Key, class Value, class ValueLayout>
+BinaryTree<Key, Value, ValueLayout>::BinaryTree()
 {
     root_ = nullptr;
     count_ = 0;
+    deferred_ = false;
+    alpha_ = 0;
+    maxCount_ = 0;
+}
+
+template <class Key, class Value, class ValueLayout>
+BinaryTree<Key, Value, ValueLayout>::~BinaryTree()
+{
+    clear();
 }
 
-template <class Key, class Value>
-BinaryTree<Key, Value>::~BinaryTree()
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::clear()
 {
-    destroy(root_);
+    MyBtNode *root = root_;
+
+    root_ = nullptr;
+    count_ = 0;
+    maxCount_ = 0;
+    if (filter_ != nullptr) {
+        filter_->clear();
+    }
+
+    releaseNodes(root);
+}
+
+template <class Key, class Value, class ValueLayout>
+typename BinaryTree<Key, Value, ValueLayout>::MyBtNode *
+BinaryTree<Key, Value, ValueLayout>::allocNode(const Key &key, const Value &val)
+{
+    if (kPooled) {
+        return new (pool_.allocate()) MyBtNode(key, val, values_);
+    }
+    return new MyBtNode(key, val, values_);
+}
+
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::freeNode(MyBtNode *x)
+{
+    x->releaseValue(values_);
+    if (kPooled) {
+        pool_.deallocate(x);
+    } else {
+        delete x;
+    }
+}
+
+/**
+ * @brief 释放已经从树上摘下的所有结点，池中的结点按块释放，否则逐个释放；
+ * 结点外的值随ValueArena整体释放
+ */
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::releaseNodes(MyBtNode *root)
+{
+    if (kOutOfLine) {
+        if (deferred_) {
+            shared_ptr<ValueArena<Value>> values = make_shared<ValueArena<Value>>();
+            values->swap(values_);
+            TreeReclaimer::instance().post([values] { values->clear(); });
+        } else {
+            values_.clear();
+        }
+    }
+
+    if (kPooled) {
+        if (deferred_) {
+            vector<void *> blocks = pool_.takeBlocks();
+            TreeReclaimer::instance().post([blocks] { NodePool<MyBtNode>::freeBlocks(blocks); });
+        } else {
+            pool_.releaseAll();
+        }
+        return;
+    }
+
+    if (root == nullptr) {
+        return;
+    }
+    if (deferred_) {
+        TreeReclaimer::instance().post([root] { destroy(root); });
+    } else {
+        destroy(root);
+    }
 }
 
-template <class Key, class Value>
-Value *BinaryTree<Key, Value>::get(MyBtNode *x, const Key &key)
+template <class Key, class Value, class ValueLayout>
+Value *BinaryTree<Key, Value, ValueLayout>::get(MyBtNode *x, const Key &key)
 {
     if (x == nullptr) {
         return nullptr;
     }
 
     if (x->key == key) {
-        return x->value;
+        return &x->value;
     }
 
     if (key < x->key) {
@@ -116,13 +344,16 @@ Value *BinaryTree<Key, Value>::get(MyBtNode *x, const Key &key)
     }
 }
 
-template <class Key, class Value>
-typename BinaryTree<Key, Value>::MyBtNode*
-BinaryTree<Key, Value>::put(MyBtNode *x, const Key &key, const Value &val)
+template <class Key, class Value, class ValueLayout>
+typename BinaryTree<Key, Value, ValueLayout>::MyBtNode*
+BinaryTree<Key, Value, ValueLayout>::put(MyBtNode *x, const Key &key, const Value &val)
 {
     if (x == nullptr) {
         count_++;
-        return new MyBtNode(key, val);
+        if (filter_ != nullptr) {
+            filter_->add(key);
+        }
+        return allocNode(key, val);
     }
 
     if (key < x->key) { // in left sub-tree
@@ -136,9 +367,9 @@ BinaryTree<Key, Value>::put(MyBtNode *x, const Key &key, const Value &val)
     return x;
 }
 
-template <class Key, class Value>
-const typename BinaryTree<Key, Value>::MyBtNode *
-BinaryTree<Key, Value>::minimum(const MyBtNode *x)
+template <class Key, class Value, class ValueLayout>
+const typename BinaryTree<Key, Value, ValueLayout>::MyBtNode *
+BinaryTree<Key, Value, ValueLayout>::minimum(const MyBtNode *x)
 {
     if (x == nullptr) {
         return x;
@@ -151,9 +382,9 @@ BinaryTree<Key, Value>::minimum(const MyBtNode *x)
     return minimum(x->left);
 }
 
-template <class Key, class Value>
-const typename BinaryTree<Key, Value>::MyBtNode *
-BinaryTree<Key, Value>::maximum(const MyBtNode *x)
+template <class Key, class Value, class ValueLayout>
+const typename BinaryTree<Key, Value, ValueLayout>::MyBtNode *
+BinaryTree<Key, Value, ValueLayout>::maximum(const MyBtNode *x)
 {
     if (x == nullptr) {
         return x;
@@ -166,9 +397,9 @@ BinaryTree<Key, Value>::maximum(const MyBtNode *x)
     return maximum(x->right);
 }
 
-template <class Key, class Value>
-typename BinaryTree<Key, Value>::MyBtNode *
-BinaryTree<Key, Value>::deleteMin(MyBtNode *x)
+template <class Key, class Value, class ValueLayout>
+typename BinaryTree<Key, Value, ValueLayout>::MyBtNode *
+BinaryTree<Key, Value, ValueLayout>::deleteMin(MyBtNode *x)
 {
     if (x == nullptr) {
         return x;
@@ -176,7 +407,7 @@ BinaryTree<Key, Value>::deleteMin(MyBtNode *x)
 
     if (x->left == nullptr) {
         MyBtNode *rightNode = x->right;
-        delete x;
+        freeNode(x);
         count_--;
         return rightNode;
     }
@@ -185,9 +416,9 @@ BinaryTree<Key, Value>::deleteMin(MyBtNode *x)
     return x;
 }
 
-template <class Key, class Value>
-typename BinaryTree<Key, Value>::MyBtNode *
-BinaryTree<Key, Value>::deleteMax(MyBtNode *x)
+template <class Key, class Value, class ValueLayout>
+typename BinaryTree<Key, Value, ValueLayout>::MyBtNode *
+BinaryTree<Key, Value, ValueLayout>::deleteMax(MyBtNode *x)
 {
     if (x == nullptr) {
         return x;
@@ -195,7 +426,7 @@ BinaryTree<Key, Value>::deleteMax(MyBtNode *x)
 
     if (x->right == nullptr) {
         MyBtNode *leftNode = x->left;
-        delete x;
+        freeNode(x);
         count_--;
         return leftNode;
     }
@@ -207,9 +438,9 @@ BinaryTree<Key, Value>::deleteMax(MyBtNode *x)
 /**
  * @brief 删除掉以node为根的二分搜索树中键值为key的结点，返回删除结点后新的二分搜索树的根
  */
-template <class Key, class Value>
-typename BinaryTree<Key, Value>::MyBtNode *
-BinaryTree<Key, Value>::deleteKey(MyBtNode *x, const Key &key)
+template <class Key, class Value, class ValueLayout>
+typename BinaryTree<Key, Value, ValueLayout>::MyBtNode *
+BinaryTree<Key, Value, ValueLayout>::deleteKey(MyBtNode *x, const Key &key)
 {
     if (x == nullptr) {
         return x;
@@ -220,52 +451,484 @@ BinaryTree<Key, Value>::deleteKey(MyBtNode *x, const Key &key)
     } else if (key > x->key) {
         x->right = deleteKey(x->right, key);
     } else {
+        filterRemove(key);
+
         if (x->left == nullptr) {
             MyBtNode *rightNode = x->right;
-            delete x;
+            freeNode(x);
             count_--;
             return rightNode; 
         }
         if (x->right == nullptr) {
             MyBtNode *leftNode = x->left;
-            delete x;
+            freeNode(x);
             count_--;
             return leftNode; 
         }
 
-        MyBtNode *successor = new MyBtNode(*minimum(x->right));
+        const MyBtNode *minNode = minimum(x->right);
+        MyBtNode *successor = allocNode(minNode->key, minNode->value);
         
         successor->right = deleteMin(x->right);
         successor->left = x->left;
 
-        delete x;
+        freeNode(x);
         return successor;
     }
 
     return x;
 }
 
-template <class Key, class Value>
-void BinaryTree<Key, Value>::destroy(MyBtNode *x)
+/* 循环下降，树退化成链表时也不会栈溢出 */
+template <class Key, class Value, class ValueLayout>
+bool BinaryTree<Key, Value, ValueLayout>::floor(const Key &key, Key &result)
+{
+    const MyBtNode *best = nullptr;
+
+    const MyBtNode *x = root_;
+    while (x != nullptr) {
+        if (key < x->key) {
+            x = x->left;
+        } else {
+            best = x;
+            if (x->key == key) {
+                break;
+            }
+            x = x->right;
+        }
+    }
+
+    if (best == nullptr) {
+        return false;
+    }
+    result = best->key;
+    return true;
+}
+
+template <class Key, class Value, class ValueLayout>
+bool BinaryTree<Key, Value, ValueLayout>::ceiling(const Key &key, Key &result)
+{
+    const MyBtNode *best = nullptr;
+
+    const MyBtNode *x = root_;
+    while (x != nullptr) {
+        if (x->key < key) {
+            x = x->right;
+        } else {
+            best = x;
+            if (x->key == key) {
+                break;
+            }
+            x = x->left;
+        }
+    }
+
+    if (best == nullptr) {
+        return false;
+    }
+    result = best->key;
+    return true;
+}
+
+template <class Key, class Value, class ValueLayout>
+int BinaryTree<Key, Value, ValueLayout>::deleteRange(const Key &lo, const Key &hi)
+{
+    if (root_ == nullptr || hi < lo) {
+        return 0;
+    }
+
+    MyBtNode *left = nullptr;
+    MyBtNode *rest = nullptr;
+    MyBtNode *mid = nullptr;
+    MyBtNode *right = nullptr;
+
+    split(root_, lo, false, left, rest);
+    split(rest, hi, true, mid, right);
+    root_ = join(left, right);
+
+    int removed = releaseRange(mid);
+    afterDelete();
+    return removed;
+}
+
+/**
+ * @brief 把子树x分裂成left(键小于key，inclusive时小于等于key)和right两棵树，
+ * 路径上的结点保留另一侧的子树，只修改一个子结点的链接
+ */
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::split(MyBtNode *x, const Key &key, bool inclusive,
+                                   MyBtNode *&left, MyBtNode *&right)
 {
     if (x == nullptr) {
+        left = nullptr;
+        right = nullptr;
         return;
     }
 
-    if (x->left != nullptr) {
-        destroy(x->left);
+    if (x->key < key || (inclusive && x->key == key)) {
+        left = x;
+        split(x->right, key, inclusive, x->right, right);
+    } else {
+        right = x;
+        split(x->left, key, inclusive, left, x->left);
     }
+}
 
-    if (x->right != nullptr) {
-        destroy(x->right);
+/**
+ * @brief left中的键都小于right中的键，摘下left的最大结点作为新的根，
+ * 新树的高度不超过两棵树中较高的一棵加1
+ */
+template <class Key, class Value, class ValueLayout>
+typename BinaryTree<Key, Value, ValueLayout>::MyBtNode *
+BinaryTree<Key, Value, ValueLayout>::join(MyBtNode *left, MyBtNode *right)
+{
+    if (left == nullptr) {
+        return right;
+    }
+
+    MyBtNode **link = &left;
+    while ((*link)->right != nullptr) {
+        link = &(*link)->right;
+    }
+
+    MyBtNode *maxNode = *link;
+    *link = maxNode->left;
+    maxNode->left = left;
+    maxNode->right = right;
+    return maxNode;
+}
+
+/**
+ * @brief 释放已经从树上分裂出来的子树x，同步过滤器，返回结点个数；与destroy一样用旋转代替递归
+ */
+template <class Key, class Value, class ValueLayout>
+int BinaryTree<Key, Value, ValueLayout>::releaseRange(MyBtNode *x)
+{
+    int removed = 0;
+    while (x != nullptr) {
+        if (x->left != nullptr) {
+            MyBtNode *left = x->left;
+            x->left = left->right;
+            left->right = x;
+            x = left;
+        } else {
+            MyBtNode *right = x->right;
+            filterRemove(x->key);
+            freeNode(x);
+            removed++;
+            x = right;
+        }
+    }
+
+    count_ -= removed;
+    return removed;
+}
+
+template <class Key, class Value, class ValueLayout>
+int BinaryTree<Key, Value, ValueLayout>::height(MyBtNode *x)
+{
+    if (x == nullptr) {
+        return 0;
+    }
+
+    return max(height(x->left), height(x->right)) + 1;
+}
+
+template <class Key, class Value, class ValueLayout>
+int BinaryTree<Key, Value, ValueLayout>::countNodes(MyBtNode *x)
+{
+    if (x == nullptr) {
+        return 0;
+    }
+
+    return countNodes(x->left) + countNodes(x->right) + 1;
+}
+
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::enableScapegoat(double alpha)
+{
+    assert(alpha > 0.5 && alpha < 1);
+
+    alpha_ = alpha;
+    rebalance();
+}
+
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::rebalance()
+{
+    root_ = rebuild(root_);
+    maxCount_ = count_;
+}
+
+/**
+ * @brief 迭代插入并记录路径；新结点过深时沿路径向上计算子树大小，找到替罪羊后重建它
+ */
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::scapegoatPut(const Key &key, const Value &val)
+{
+    path_.clear();
+
+    MyBtNode **link = &root_;
+    while (*link != nullptr) {
+        MyBtNode *x = *link;
+        if (key < x->key) {
+            link = &x->left;
+        } else if (key > x->key) {
+            link = &x->right;
+        } else {
+            x->value = val;
+            return;
+        }
+        path_.push_back(x);
+    }
+
+    MyBtNode *child = allocNode(key, val);
+    *link = child;
+    count_++;
+    maxCount_ = max(maxCount_, count_);
+    if (filter_ != nullptr) {
+        filter_->add(key);
+    }
+
+    int depth = static_cast<int>(path_.size());
+    if (depth <= static_cast<int>(log(maxCount_) / log(1 / alpha_))) {
+        return;
+    }
+
+    int childSize = 1;
+    for (int i = depth - 1; i >= 0; i--) {
+        MyBtNode *parent = path_[i];
+        MyBtNode *sibling = parent->left == child ? parent->right : parent->left;
+        int parentSize = childSize + countNodes(sibling) + 1;
+
+        if (childSize > alpha_ * parentSize) {
+            MyBtNode *&parentLink = i == 0 ? root_
+                                  : (path_[i - 1]->left == parent ? path_[i - 1]->left : path_[i - 1]->right);
+            parentLink = rebuild(parent);
+            return;
+        }
+
+        child = parent;
+        childSize = parentSize;
+    }
+}
+
+/**
+ * @brief 替罪羊树模式下删除使键数降到alpha * maxCount以下时，重建整棵树
+ */
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::afterDelete()
+{
+    if (alpha_ > 0 && count_ < alpha_ * maxCount_) {
+        rebalance();
+    }
+}
+
+template <class Key, class Value, class ValueLayout>
+typename BinaryTree<Key, Value, ValueLayout>::MyBtNode *
+BinaryTree<Key, Value, ValueLayout>::rebuild(MyBtNode *root)
+{
+    int size = treeToVine(root);
+    vineToTree(root, size);
+    return root;
+}
+
+/**
+ * @brief 沿右链不断右旋，直到链上的结点都没有左子结点，返回结点个数
+ */
+template <class Key, class Value, class ValueLayout>
+int BinaryTree<Key, Value, ValueLayout>::treeToVine(MyBtNode *&root)
+{
+    int size = 0;
+
+    MyBtNode **link = &root;
+    while (*link != nullptr) {
+        MyBtNode *x = *link;
+        if (x->left == nullptr) {
+            size++;
+            link = &x->right;
+        } else {
+            MyBtNode *left = x->left;
+            x->left = left->right;
+            left->right = x;
+            *link = left;
+        }
+    }
+
+    return size;
+}
+
+/**
+ * @brief 先压缩出最底层多余的叶子，使剩下的结点数为2^k - 1，再每轮把链的长度减半
+ */
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::vineToTree(MyBtNode *&root, int size)
+{
+    int full = 1;
+    while (full * 2 <= size + 1) {
+        full *= 2;
+    }
+
+    int leaves = size + 1 - full;
+    compress(root, leaves);
+
+    size -= leaves;
+    while (size > 1) {
+        size /= 2;
+        compress(root, size);
+    }
+}
+
+/**
+ * @brief 从链头开始，对链上第1、3、5...个结点各做一次左旋，共count次
+ */
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::compress(MyBtNode *&root, int count)
+{
+    MyBtNode **link = &root;
+    for (int i = 0; i < count; i++) {
+        MyBtNode *child = *link;
+        MyBtNode *next = child->right;
+
+        *link = next;
+        child->right = next->left;
+        next->left = child;
+        link = &next->right;
+    }
+}
+
+/**
+ * 不断把x的左子结点右旋到x的位置，直到x没有左子树，再释放x并转到右子树，
+ * 每个结点最多参与一次旋转，不需要递归和额外的栈
+ */
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::destroy(MyBtNode *x)
+{
+    while (x != nullptr) {
+        if (x->left != nullptr) {
+            MyBtNode *left = x->left;
+            x->left = left->right;
+            left->right = x;
+            x = left;
+        } else {
+            MyBtNode *right = x->right;
+            delete x;
+            x = right;
+        }
+    }
+}
+
+template <class Key, class Value, class ValueLayout>
+template <class Hash>
+void BinaryTree<Key, Value, ValueLayout>::enableFilter(int expectedKeys, double fpRate)
+{
+    size_t capacity = static_cast<size_t>(max(expectedKeys, count_));
+    filter_.reset(new CountingBloomFilter<Key>(capacity, fpRate,
+                                               &CountingBloomFilter<Key>::template hashWith<Hash>));
+    fillFilter(root_);
+}
+
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::rebuildFilter()
+{
+    if (filter_ == nullptr) {
+        return;
+    }
+
+    resetFilter(max(filter_->capacity(), static_cast<size_t>(count_)));
+}
+
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::resetFilter(size_t capacity)
+{
+    filter_.reset(new CountingBloomFilter<Key>(capacity, filter_->fpRate(), filter_->hashFunc()));
+    fillFilter(root_);
+}
+
+template <class Key, class Value, class ValueLayout>
+TreeMemoryUsage BinaryTree<Key, Value, ValueLayout>::memoryUsage()
+{
+    TreeMemoryUsage usage;
+    usage.entries = count_;
+    usage.nodeBytes = count_ * sizeof(MyBtNode);
+    if (kPooled) {
+        usage.allocatorOverhead = pool_.memoryUsage() - usage.nodeBytes;
+    } else {
+        usage.allocatorOverhead = count_ * (allocatedSize(sizeof(MyBtNode)) - sizeof(MyBtNode));
+    }
+    if (kOutOfLine) {
+        usage.nodeBytes += count_ * sizeof(Value);
+        usage.allocatorOverhead += values_.memoryUsage() - count_ * sizeof(Value);
+    }
+    usage.auxiliaryBytes = sizeof(*this);
+    if (filter_ != nullptr) {
+        usage.auxiliaryBytes += filter_->memoryUsage();
+    }
+    return usage;
+}
+
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::shrink()
+{
+    if (filter_ != nullptr) {
+        resetFilter(max(count_, 1));
+    }
+    size_t live = static_cast<size_t>(count_);
+    if ((kPooled && pool_.capacity() > 2 * live) || (kOutOfLine && values_.capacity() > 2 * live)) {
+        NodePool<MyBtNode> freshNodes;
+        ValueArena<Value> freshValues;
+        relocate(freshNodes, freshValues);
+        pool_.swap(freshNodes);
+        values_.swap(freshValues);
+    }
+    trimHeap();
+}
+
+/**
+ * @brief 把整棵树逐个复制到pool中，结点外的值复制到values中
+ * 池中的旧结点和旧的值留在原来的池和区域中整体释放，不在池中的旧结点逐个释放；
+ * 栈中保存待复制结点的链接，树退化成链表时也不会栈溢出
+ */
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::relocate(NodePool<MyBtNode> &pool, ValueArena<Value> &values)
+{
+    vector<MyBtNode **> links;
+    links.push_back(&root_);
+    while (!links.empty()) {
+        MyBtNode **link = links.back();
+        links.pop_back();
+        if (*link == nullptr) {
+            continue;
+        }
+
+        MyBtNode *x = *link;
+        MyBtNode *y = kPooled ? new (pool.allocate()) MyBtNode(x->key, x->value, values)
+                              : new MyBtNode(x->key, x->value, values);
+        y->left = x->left;
+        y->right = x->right;
+        *link = y;
+        if (!kPooled) {
+            delete x;
+        }
+        links.push_back(&y->left);
+        links.push_back(&y->right);
+    }
+}
+
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::fillFilter(MyBtNode *x)
+{
+    if (x == nullptr) {
+        return;
     }
 
-    count_--;
-    delete x;
+    fillFilter(x->left);
+    filter_->add(x->key);
+    fillFilter(x->right);
 }
 
-template <class Key, class Value>
-void BinaryTree<Key, Value>::preOrder(MyBtNode *x)
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::preOrder(MyBtNode *x)
 {
     if (x == nullptr) {
         return;
@@ -276,8 +939,8 @@ void BinaryTree<Key, Value>::preOrder(MyBtNode *x)
     preOrder(x->right);
 }
 
-template <class Key, class Value>
-void BinaryTree<Key, Value>::inOrder(MyBtNode *x)
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::inOrder(MyBtNode *x)
 {
     if (x == nullptr) {
         return;
@@ -288,8 +951,8 @@ void BinaryTree<Key, Value>::inOrder(MyBtNode *x)
     inOrder(x->right);
 }
 
-template <class Key, class Value>
-void BinaryTree<Key, Value>::postOrder(MyBtNode *x)
+template <class Key, class Value, class ValueLayout>
+void BinaryTree<Key, Value, ValueLayout>::postOrder(MyBtNode *x)
 {
     if (x == nullptr) {
         return;
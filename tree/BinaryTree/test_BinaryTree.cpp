@@ -29,5 +29,33 @@ int main(int argc, char **argv)
     cout << "MAX: " << bt.maximum() << endl;
     cout << "MIN: " << bt.minimum() << endl;
 
+    int bound;
+    if (bt.floor(4, bound)) {
+        cout << "floor(4): " << bound << endl;
+    }
+    if (bt.ceiling(4, bound)) {
+        cout << "ceiling(4): " << bound << endl;
+    }
+
+    // 有序插入使树退化成链表，clear不递归，不会栈溢出
+    BinaryTree<int, int> chain;
+    for (int i = 0; i < 1000; i++) {
+        chain.put(i, i);
+    }
+    cout << "chain height: " << chain.height() << endl;
+    chain.rebalance();
+    cout << "chain height after rebalance: " << chain.height() << endl;
+    chain.clear();
+    cout << "chain size after clear: " << chain.size() << endl;
+
+    // 替罪羊树模式下有序插入也保持对数高度
+    BinaryTree<int, int> scapegoat;
+    scapegoat.enableScapegoat(0.7);
+    for (int i = 0; i < 1000; i++) {
+        scapegoat.put(i, i);
+    }
+    cout << "scapegoat height: " << scapegoat.height() << endl;
+    cout << "deleteRange(100, 899): " << scapegoat.deleteRange(100, 899) << ", left: " << scapegoat.size() << endl;
+
     return 0;
 }
\ No newline at end of file
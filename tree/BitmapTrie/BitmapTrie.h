@@ -0,0 +1,392 @@
+#ifndef __BITMAPTRIE_H_
+#define __BITMAPTRIE_H_
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include <type_traits>
+using namespace std;
+
+/**
+ * 整数键的多级位图trie，用来替代AVLTree<int, ...>这类整数键的有序表
+ * 1. 键按6位一段从高位到低位切分，每个结点对应一段，最多有64个子结点，
+ *    32位的键固定6层，64位的键固定11层，查找不做键的比较，也与n无关
+ * 2. 结点用一个64位的位图记录哪些子结点存在，子结点按位图中的顺序紧凑存放，
+ *    第d个子结点的下标为popcount(bitmap & ((1 << d) - 1))
+ * 3. floor/ceiling在每层用一次clz/ctz找到相邻的非空子结点，最多回溯一次，
+ *    代价为O(w / 6)次字操作(w为键的位数)
+ * 有符号的键翻转符号位后按无符号数排序，与原来的大小顺序一致
+ */
+template <class Key, class Value>
+class BitmapTrie {
+public:
+    static_assert(is_integral<Key>::value, "BitmapTrie requires an integral key");
+
+    BitmapTrie();
+    ~BitmapTrie();
+
+    BitmapTrie(const BitmapTrie &) = delete;
+    BitmapTrie &operator=(const BitmapTrie &) = delete;
+
+public:
+    int size() { return count_; }
+    bool isEmpty() { return count_ == 0; }
+    bool contain(const Key &key) { return get(key) != nullptr; }
+
+    Value *get(const Key &key);
+    void put(const Key &key, const Value &val);
+    void deleteKey(const Key &key);
+
+    Key minimum();
+    Key maximum();
+
+    /* 小于等于key的最大键，不存在时返回false */
+    bool floor(const Key &key, Key &result);
+
+    /* 大于等于key的最小键，不存在时返回false */
+    bool ceiling(const Key &key, Key &result);
+
+    /* 按键的升序访问[lo, hi]之间的所有键值对，fn(key, value) */
+    template <class Func>
+    void forEach(const Key &lo, const Key &hi, Func fn);
+
+private:
+    using UKey = typename make_unsigned<Key>::type;
+
+    static const int kBits = numeric_limits<UKey>::digits;
+    static const int kLevels = (kBits + 5) / 6;
+
+    /**
+     * 最后一层的结点保存值，其它层的结点保存子结点
+     */
+    struct Node {
+        uint64_t bitmap;
+        vector<Node *> children;
+        vector<Value> values;
+
+        Node() : bitmap(0) {}
+    };
+
+    static UKey toUnsigned(Key key) {
+        UKey u = static_cast<UKey>(key);
+        return is_signed<Key>::value ? u ^ (UKey(1) << (kBits - 1)) : u;
+    }
+    static Key toKey(UKey u) {
+        return static_cast<Key>(is_signed<Key>::value ? u ^ (UKey(1) << (kBits - 1)) : u);
+    }
+
+    static int shiftOf(int level) { return (kLevels - 1 - level) * 6; }
+    static int digitOf(UKey u, int level) { return static_cast<int>((u >> shiftOf(level)) & 63); }
+    static bool isLeafLevel(int level) { return level == kLevels - 1; }
+
+    static bool hasBit(const Node *x, int d) { return (x->bitmap >> d) & 1; }
+    static int indexOf(const Node *x, int d) { return __builtin_popcountll(x->bitmap & ((uint64_t(1) << d) - 1)); }
+
+    /* 大于d、小于d的最近的非空子结点，不存在时返回-1 */
+    static int nextBit(const Node *x, int d);
+    static int prevBit(const Node *x, int d);
+
+    bool deleteKey(Node *x, int level, UKey u);
+
+    UKey minimum(const Node *x, int level, UKey prefix);
+    UKey maximum(const Node *x, int level, UKey prefix);
+
+    bool ceiling(const Node *x, int level, UKey u, UKey prefix, UKey &result);
+    bool floor(const Node *x, int level, UKey u, UKey prefix, UKey &result);
+
+    template <class Func>
+    void forEach(Node *x, int level, UKey prefix, UKey lo, UKey hi, Func &fn);
+
+    void destroy(Node *x, int level);
+
+private:
+    Node *root_;
+    int count_;
+};
+
+template <class Key, class Value>
+BitmapTrie<Key, Value>::BitmapTrie()
+{
+    root_ = new Node();
+    count_ = 0;
+}
+
+template <class Key, class Value>
+BitmapTrie<Key, Value>::~BitmapTrie()
+{
+    destroy(root_, 0);
+}
+
+template <class Key, class Value>
+void BitmapTrie<Key, Value>::destroy(Node *x, int level)
+{
+    if (!isLeafLevel(level)) {
+        for (Node *child : x->children) {
+            destroy(child, level + 1);
+        }
+    }
+    delete x;
+}
+
+template <class Key, class Value>
+int BitmapTrie<Key, Value>::nextBit(const Node *x, int d)
+{
+    uint64_t mask = d >= 63 ? 0 : x->bitmap & (~uint64_t(0) << (d + 1));
+    return mask == 0 ? -1 : __builtin_ctzll(mask);
+}
+
+template <class Key, class Value>
+int BitmapTrie<Key, Value>::prevBit(const Node *x, int d)
+{
+    uint64_t mask = x->bitmap & ((uint64_t(1) << d) - 1);
+    return mask == 0 ? -1 : 63 - __builtin_clzll(mask);
+}
+
+template <class Key, class Value>
+Value *BitmapTrie<Key, Value>::get(const Key &key)
+{
+    UKey u = toUnsigned(key);
+    Node *x = root_;
+
+    for (int level = 0; ; level++) {
+        int d = digitOf(u, level);
+        if (!hasBit(x, d)) {
+            return nullptr;
+        }
+
+        if (isLeafLevel(level)) {
+            return &x->values[indexOf(x, d)];
+        }
+        x = x->children[indexOf(x, d)];
+    }
+}
+
+template <class Key, class Value>
+void BitmapTrie<Key, Value>::put(const Key &key, const Value &val)
+{
+    UKey u = toUnsigned(key);
+    Node *x = root_;
+
+    for (int level = 0; ; level++) {
+        int d = digitOf(u, level);
+        int i = indexOf(x, d);
+
+        if (isLeafLevel(level)) {
+            if (hasBit(x, d)) {
+                x->values[i] = val;
+            } else {
+                x->values.insert(x->values.begin() + i, val);
+                x->bitmap |= uint64_t(1) << d;
+                count_++;
+            }
+            return;
+        }
+
+        if (!hasBit(x, d)) {
+            x->children.insert(x->children.begin() + i, new Node());
+            x->bitmap |= uint64_t(1) << d;
+        }
+        x = x->children[i];
+    }
+}
+
+template <class Key, class Value>
+void BitmapTrie<Key, Value>::deleteKey(const Key &key)
+{
+    deleteKey(root_, 0, toUnsigned(key));
+}
+
+/**
+ * @brief 从子树x中删除u，返回x是否变为空结点，空结点由上一层释放
+ */
+template <class Key, class Value>
+bool BitmapTrie<Key, Value>::deleteKey(Node *x, int level, UKey u)
+{
+    int d = digitOf(u, level);
+    if (!hasBit(x, d)) {
+        return false;
+    }
+
+    int i = indexOf(x, d);
+    if (isLeafLevel(level)) {
+        x->values.erase(x->values.begin() + i);
+        count_--;
+    } else {
+        Node *child = x->children[i];
+        if (!deleteKey(child, level + 1, u)) {
+            return false;
+        }
+        delete child;
+        x->children.erase(x->children.begin() + i);
+    }
+
+    x->bitmap &= ~(uint64_t(1) << d);
+    return x->bitmap == 0;
+}
+
+template <class Key, class Value>
+typename BitmapTrie<Key, Value>::UKey
+BitmapTrie<Key, Value>::minimum(const Node *x, int level, UKey prefix)
+{
+    for (;; level++) {
+        int d = __builtin_ctzll(x->bitmap);
+        prefix |= static_cast<UKey>(d) << shiftOf(level);
+        if (isLeafLevel(level)) {
+            return prefix;
+        }
+        x = x->children.front();
+    }
+}
+
+template <class Key, class Value>
+typename BitmapTrie<Key, Value>::UKey
+BitmapTrie<Key, Value>::maximum(const Node *x, int level, UKey prefix)
+{
+    for (;; level++) {
+        int d = 63 - __builtin_clzll(x->bitmap);
+        prefix |= static_cast<UKey>(d) << shiftOf(level);
+        if (isLeafLevel(level)) {
+            return prefix;
+        }
+        x = x->children.back();
+    }
+}
+
+template <class Key, class Value>
+Key BitmapTrie<Key, Value>::minimum()
+{
+    assert(count_ != 0);
+    return toKey(minimum(root_, 0, 0));
+}
+
+template <class Key, class Value>
+Key BitmapTrie<Key, Value>::maximum()
+{
+    assert(count_ != 0);
+    return toKey(maximum(root_, 0, 0));
+}
+
+/**
+ * 先尝试与u相同的子结点，失败时取右侧最近的非空子结点中的最小键，
+ * 每层最多进入一个子结点，再加上一次取最小键的下降
+ */
+template <class Key, class Value>
+bool BitmapTrie<Key, Value>::ceiling(const Node *x, int level, UKey u, UKey prefix, UKey &result)
+{
+    int d = digitOf(u, level);
+    int shift = shiftOf(level);
+
+    if (hasBit(x, d)) {
+        if (isLeafLevel(level)) {
+            result = prefix | static_cast<UKey>(d);
+            return true;
+        }
+        if (ceiling(x->children[indexOf(x, d)], level + 1, u, prefix | (static_cast<UKey>(d) << shift), result)) {
+            return true;
+        }
+    }
+
+    int next = nextBit(x, d);
+    if (next < 0) {
+        return false;
+    }
+
+    prefix |= static_cast<UKey>(next) << shift;
+    result = isLeafLevel(level) ? prefix : minimum(x->children[indexOf(x, next)], level + 1, prefix);
+    return true;
+}
+
+template <class Key, class Value>
+bool BitmapTrie<Key, Value>::floor(const Node *x, int level, UKey u, UKey prefix, UKey &result)
+{
+    int d = digitOf(u, level);
+    int shift = shiftOf(level);
+
+    if (hasBit(x, d)) {
+        if (isLeafLevel(level)) {
+            result = prefix | static_cast<UKey>(d);
+            return true;
+        }
+        if (floor(x->children[indexOf(x, d)], level + 1, u, prefix | (static_cast<UKey>(d) << shift), result)) {
+            return true;
+        }
+    }
+
+    int prev = prevBit(x, d);
+    if (prev < 0) {
+        return false;
+    }
+
+    prefix |= static_cast<UKey>(prev) << shift;
+    result = isLeafLevel(level) ? prefix : maximum(x->children[indexOf(x, prev)], level + 1, prefix);
+    return true;
+}
+
+template <class Key, class Value>
+bool BitmapTrie<Key, Value>::ceiling(const Key &key, Key &result)
+{
+    UKey u;
+    if (!ceiling(root_, 0, toUnsigned(key), 0, u)) {
+        return false;
+    }
+
+    result = toKey(u);
+    return true;
+}
+
+template <class Key, class Value>
+bool BitmapTrie<Key, Value>::floor(const Key &key, Key &result)
+{
+    UKey u;
+    if (!floor(root_, 0, toUnsigned(key), 0, u)) {
+        return false;
+    }
+
+    result = toKey(u);
+    return true;
+}
+
+template <class Key, class Value>
+template <class Func>
+void BitmapTrie<Key, Value>::forEach(const Key &lo, const Key &hi, Func fn)
+{
+    if (hi < lo) {
+        return;
+    }
+    forEach(root_, 0, 0, toUnsigned(lo), toUnsigned(hi), fn);
+}
+
+/**
+ * 只进入与[lo, hi]相交的子结点，prefix是x对应的键的高位部分
+ */
+template <class Key, class Value>
+template <class Func>
+void BitmapTrie<Key, Value>::forEach(Node *x, int level, UKey prefix, UKey lo, UKey hi, Func &fn)
+{
+    int shift = shiftOf(level);
+    UKey span = (static_cast<UKey>(1) << shift) - 1; // 子结点覆盖的低位范围
+
+    uint64_t bits = x->bitmap;
+    while (bits != 0) {
+        int d = __builtin_ctzll(bits);
+        bits &= bits - 1;
+
+        UKey first = prefix | (static_cast<UKey>(d) << shift);
+        UKey last = first | span;
+        if (last < lo) {
+            continue;
+        }
+        if (hi < first) {
+            return;
+        }
+
+        if (isLeafLevel(level)) {
+            fn(toKey(first), x->values[indexOf(x, d)]);
+        } else {
+            forEach(x->children[indexOf(x, d)], level + 1, first, lo, hi, fn);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include "BitmapTrie.h"
+
+#include <iostream>
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    BitmapTrie<int, int> trie;
+
+    int keys[] = {5, -3, 1024, 7, 0, -100000, 65, 64};
+    for (int key : keys) {
+        trie.put(key, key * 2);
+    }
+    cout << "size: " << trie.size() << endl;
+
+    trie.forEach(-1000000, 1000000, [](const int &key, const int &val) {
+        cout << "(" << key << ", " << val << ") ";
+    });
+    cout << endl;
+
+    cout << "MIN: " << trie.minimum() << endl;
+    cout << "MAX: " << trie.maximum() << endl;
+
+    int result;
+    if (trie.floor(63, result)) {
+        cout << "floor(63): " << result << endl;
+    }
+    if (trie.ceiling(66, result)) {
+        cout << "ceiling(66): " << result << endl;
+    }
+
+    trie.deleteKey(7);
+    trie.deleteKey(1024);
+    cout << "contain(7): " << trie.contain(7) << endl;
+    if (trie.ceiling(8, result)) {
+        cout << "ceiling(8): " << result << endl;
+    }
+    if (!trie.ceiling(1000, result)) {
+        cout << "ceiling(1000): none" << endl;
+    }
+
+    return 0;
+}
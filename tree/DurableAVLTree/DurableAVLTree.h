@@ -0,0 +1,657 @@
+#ifndef __DURABLEAVLTREE_H_
+#define __DURABLEAVLTREE_H_
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "../AVLTree/AVLTree.h"
+using namespace std;
+
+/**
+ * 日志与checkpoint的配置
+ */
+struct WalOptions {
+    /* 写操作返回前是否等待日志落盘，多个线程同时等待时只由一个线程执行一次fsync(group commit) */
+    bool syncOnWrite = true;
+
+    /* syncOnWrite为false时，每累计batchRecords条日志执行一次写文件和fsync */
+    int batchRecords = 256;
+
+    /* 日志累计checkpointRecords条后自动做checkpoint，<= 0表示只在调用checkpoint()时进行 */
+    int checkpointRecords = 1 << 20;
+};
+
+/**
+ * 带预写日志(WAL)的AVL树，进程崩溃后可以从磁盘恢复
+ * 1. put/deleteKey先追加一条日志到内存缓冲区；syncOnWrite时修改在日志落盘后按日志顺序
+ *    应用到内存中的树，写入失败的修改对读者永远不可见；否则立即修改内存中的树
+ * 2. 缓冲区由一个线程统一写入文件并fsync，等待期间到达的写操作在下一批中一起提交
+ * 3. checkpoint在锁内复制整棵树，在锁外写入临时文件、fsync后rename为正式文件，
+ *    最后用只包含快照之后日志的新文件替换旧日志；checkpoint期间读写不被阻塞
+ * 4. open时先加载checkpoint，再按顺序重放日志，日志尾部不完整或校验失败的记录被丢弃
+ * 键和值按内存布局直接写入文件，因此必须是trivially copyable的类型
+ */
+template <class Key, class Value>
+class DurableAVLTree {
+public:
+    using MyAVLTree = AVLTree<Key, Value>;
+
+    static_assert(is_trivially_copyable<Key>::value, "Key must be trivially copyable");
+    static_assert(is_trivially_copyable<Value>::value, "Value must be trivially copyable");
+
+    explicit DurableAVLTree(const WalOptions &options = WalOptions());
+    ~DurableAVLTree();
+
+    DurableAVLTree(const DurableAVLTree &) = delete;
+    DurableAVLTree &operator=(const DurableAVLTree &) = delete;
+
+public:
+    /* 打开目录dir下的数据，目录不存在数据时得到一棵空树 */
+    bool open(const string &dir);
+    void close();
+
+    int size();
+    bool isEmpty() { return size() == 0; }
+    bool contain(const Key &key);
+    bool get(const Key &key, Value &val);
+
+    /* 返回false表示日志写入失败，之后的写操作都会失败 */
+    bool put(const Key &key, const Value &val);
+    bool deleteKey(const Key &key);
+
+    /* 等待之前所有的写操作落盘 */
+    bool sync();
+    bool checkpoint();
+
+private:
+    enum : uint8_t {
+        OP_PUT = 1,
+        OP_DELETE = 2
+    };
+
+    static const size_t kRecordSize = sizeof(uint32_t) + 1 + sizeof(Key) + sizeof(Value);
+    static const uint32_t kCheckpointMagic = 0x41564c43; // "AVLC"
+
+    void appendRecord(uint8_t op, const Key &key, const Value *val);
+    void apply(uint8_t op, const Key &key, const Value &val);
+    void applyDurable();
+    bool commit(unique_lock<mutex> &lock);
+    bool flushTo(unique_lock<mutex> &lock, uint64_t lsn);
+    bool checkpointLocked(unique_lock<mutex> &lock);
+    bool resetLog();
+
+    bool loadCheckpoint();
+    long replayLog();
+
+    static uint32_t crc32(const char *data, size_t n, uint32_t crc = 0);
+    static bool syncFile(FILE *fp);
+    static bool syncDir(const string &dir);
+    static bool writeAll(FILE *fp, const string &data);
+
+    string walPath() { return dir_ + "/wal.log"; }
+    string checkpointPath() { return dir_ + "/checkpoint.dat"; }
+
+private:
+    WalOptions options_;
+    string dir_;
+    FILE *wal_;
+
+    mutex mutex_;
+    condition_variable flushed_;
+    MyAVLTree tree_;
+
+    struct PendingOp {
+        uint64_t lsn;
+        uint8_t op;
+        Key key;
+        Value value;
+    };
+
+    string buffer_;          // 尚未写入文件的日志
+    deque<PendingOp> pending_; // syncOnWrite时日志尚未落盘、还没有应用到树上的修改
+    uint64_t lastLsn_;       // 最后一条日志的序号
+    uint64_t durableLsn_;    // 已经落盘的最大日志序号
+    uint64_t logRecords_;    // 上次checkpoint之后的日志条数
+    string carry_;           // checkpoint期间写入旧日志文件的日志，要搬到新的日志文件中
+    bool flushing_;
+    bool checkpointing_;
+    bool failed_;
+};
+
+template <class Key, class Value>
+DurableAVLTree<Key, Value>::DurableAVLTree(const WalOptions &options)
+{
+    options_ = options;
+    wal_ = nullptr;
+    lastLsn_ = 0;
+    durableLsn_ = 0;
+    logRecords_ = 0;
+    flushing_ = false;
+    checkpointing_ = false;
+    failed_ = false;
+}
+
+template <class Key, class Value>
+DurableAVLTree<Key, Value>::~DurableAVLTree()
+{
+    close();
+}
+
+/**
+ * 恢复顺序: checkpoint -> 日志重放 -> 日志非空时立即checkpoint，
+ * 这样日志尾部损坏的记录随着日志被清空一起丢弃，新的日志不会追加在损坏的记录之后
+ */
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::open(const string &dir)
+{
+    unique_lock<mutex> lock(mutex_);
+    assert(wal_ == nullptr);
+
+    dir_ = dir;
+    if (!loadCheckpoint()) {
+        return false;
+    }
+
+    long logBytes = replayLog();
+    if (logBytes < 0) {
+        return false;
+    }
+
+    if (logBytes > 0) {
+        return checkpointLocked(lock);
+    }
+
+    wal_ = fopen(walPath().c_str(), "ab");
+    return wal_ != nullptr;
+}
+
+template <class Key, class Value>
+void DurableAVLTree<Key, Value>::close()
+{
+    unique_lock<mutex> lock(mutex_);
+    while (checkpointing_) {
+        flushed_.wait(lock);
+    }
+    if (wal_ == nullptr) {
+        return;
+    }
+
+    flushTo(lock, lastLsn_);
+    fclose(wal_);
+    wal_ = nullptr;
+}
+
+template <class Key, class Value>
+int DurableAVLTree<Key, Value>::size()
+{
+    lock_guard<mutex> guard(mutex_);
+    return tree_.size();
+}
+
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::contain(const Key &key)
+{
+    lock_guard<mutex> guard(mutex_);
+    return tree_.contain(key);
+}
+
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::get(const Key &key, Value &val)
+{
+    lock_guard<mutex> guard(mutex_);
+
+    Value *found = tree_.get(key);
+    if (found == nullptr) {
+        return false;
+    }
+
+    val = *found;
+    return true;
+}
+
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::put(const Key &key, const Value &val)
+{
+    unique_lock<mutex> lock(mutex_);
+    if (wal_ == nullptr || failed_) {
+        return false;
+    }
+
+    appendRecord(OP_PUT, key, &val);
+    apply(OP_PUT, key, val);
+
+    return commit(lock);
+}
+
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::deleteKey(const Key &key)
+{
+    unique_lock<mutex> lock(mutex_);
+    if (wal_ == nullptr || failed_) {
+        return false;
+    }
+
+    // 还有未应用的修改时树中的内容不是最新的，不能据此省略日志
+    if (pending_.empty() && !tree_.contain(key)) {
+        return true;
+    }
+
+    appendRecord(OP_DELETE, key, nullptr);
+    apply(OP_DELETE, key, Value());
+
+    return commit(lock);
+}
+
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::sync()
+{
+    unique_lock<mutex> lock(mutex_);
+    if (wal_ == nullptr) {
+        return false;
+    }
+
+    return flushTo(lock, lastLsn_);
+}
+
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::checkpoint()
+{
+    unique_lock<mutex> lock(mutex_);
+    if (wal_ == nullptr) {
+        return false;
+    }
+
+    return checkpointLocked(lock);
+}
+
+/**
+ * 日志记录: | crc32 | op | key | value |，删除操作的value部分填0，
+ * crc覆盖crc之后的所有字节
+ */
+template <class Key, class Value>
+void DurableAVLTree<Key, Value>::appendRecord(uint8_t op, const Key &key, const Value *val)
+{
+    char record[kRecordSize];
+    memset(record, 0, sizeof(record));
+
+    char *p = record + sizeof(uint32_t);
+    *p++ = static_cast<char>(op);
+    memcpy(p, &key, sizeof(Key));
+    p += sizeof(Key);
+    if (val != nullptr) {
+        memcpy(p, val, sizeof(Value));
+    }
+
+    uint32_t crc = crc32(record + sizeof(uint32_t), kRecordSize - sizeof(uint32_t));
+    memcpy(record, &crc, sizeof(crc));
+
+    buffer_.append(record, kRecordSize);
+    lastLsn_++;
+    logRecords_++;
+}
+
+/**
+ * @brief syncOnWrite时把刚追加的日志对应的修改挂起，等日志落盘后再应用，否则立即应用
+ */
+template <class Key, class Value>
+void DurableAVLTree<Key, Value>::apply(uint8_t op, const Key &key, const Value &val)
+{
+    if (options_.syncOnWrite) {
+        pending_.push_back(PendingOp{lastLsn_, op, key, val});
+    } else if (op == OP_PUT) {
+        tree_.put(key, val);
+    } else {
+        tree_.deleteKey(key);
+    }
+}
+
+/**
+ * @brief 按日志顺序应用所有已经落盘的挂起修改，持有mutex_时调用
+ * 同一个键的多个写者被唤醒的顺序不确定，统一在这里应用才能与重放日志的结果一致
+ */
+template <class Key, class Value>
+void DurableAVLTree<Key, Value>::applyDurable()
+{
+    while (!pending_.empty() && pending_.front().lsn <= durableLsn_) {
+        const PendingOp &op = pending_.front();
+        if (op.op == OP_PUT) {
+            tree_.put(op.key, op.value);
+        } else {
+            tree_.deleteKey(op.key);
+        }
+        pending_.pop_front();
+    }
+}
+
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::commit(unique_lock<mutex> &lock)
+{
+    bool ok = true;
+    if (options_.syncOnWrite) {
+        ok = flushTo(lock, lastLsn_);
+    } else if (lastLsn_ - durableLsn_ >= static_cast<uint64_t>(max(options_.batchRecords, 1))) {
+        ok = flushTo(lock, lastLsn_);
+    }
+
+    if (ok && !checkpointing_ && options_.checkpointRecords > 0 &&
+        logRecords_ >= static_cast<uint64_t>(options_.checkpointRecords)) {
+        ok = checkpointLocked(lock);
+    }
+
+    return ok;
+}
+
+/**
+ * @brief 保证序号<=lsn的日志已经落盘
+ * 同一时刻只有一个线程(leader)在锁外写文件和fsync，其它线程等待它完成；
+ * leader写文件期间新追加的日志留在buffer_中，由下一个leader一起提交
+ */
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::flushTo(unique_lock<mutex> &lock, uint64_t lsn)
+{
+    while (durableLsn_ < lsn && !failed_) {
+        if (flushing_) {
+            flushed_.wait(lock);
+            continue;
+        }
+
+        flushing_ = true;
+        string batch;
+        batch.swap(buffer_);
+        uint64_t batchLsn = lastLsn_;
+
+        lock.unlock();
+        bool ok = writeAll(wal_, batch) && syncFile(wal_);
+        lock.lock();
+
+        flushing_ = false;
+        if (ok) {
+            if (checkpointing_) {
+                carry_.append(batch);
+            }
+            durableLsn_ = batchLsn;
+            applyDurable();
+        } else {
+            failed_ = true;
+            pending_.clear(); // 之后的写操作都会失败，挂起的修改全部作废
+        }
+        flushed_.notify_all();
+    }
+
+    return !failed_;
+}
+
+/**
+ * checkpoint文件: | magic | count | (key, value) * count | crc32 |
+ * 锁内只把树复制到内存中，写临时文件、fsync、rename都在锁外进行，同一时刻只有一个checkpoint；
+ * syncOnWrite时树中恰好包含已经落盘的修改，否则包含所有修改，快照对应的日志序号据此确定
+ * 快照之后的日志必须保留: 期间落盘的批次记在carry_中，还没有写的仍然留在buffer_中
+ * 重放一段覆盖快照序号的日志得到的结果与快照一致，所以rename之后任何时刻崩溃都能正确恢复
+ */
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::checkpointLocked(unique_lock<mutex> &lock)
+{
+    while (checkpointing_) {
+        flushed_.wait(lock);
+    }
+    if (failed_) {
+        return false;
+    }
+
+    uint64_t snapshotLsn = options_.syncOnWrite ? durableLsn_ : lastLsn_;
+
+    string data;
+    uint32_t magic = kCheckpointMagic;
+    uint64_t count = static_cast<uint64_t>(tree_.size());
+    data.reserve(sizeof(magic) + sizeof(count) + count * (sizeof(Key) + sizeof(Value)) + sizeof(uint32_t));
+    data.append(reinterpret_cast<const char *>(&magic), sizeof(magic));
+    data.append(reinterpret_cast<const char *>(&count), sizeof(count));
+
+    if (!tree_.isEmpty()) {
+        tree_.forEach(tree_.minimum(), tree_.maximum(), [&data](const Key &key, const Value &value) {
+            data.append(reinterpret_cast<const char *>(&key), sizeof(Key));
+            data.append(reinterpret_cast<const char *>(&value), sizeof(Value));
+        });
+    }
+
+    checkpointing_ = true;
+    carry_.clear();
+    lock.unlock();
+
+    uint32_t crc = crc32(data.data(), data.size());
+    data.append(reinterpret_cast<const char *>(&crc), sizeof(crc));
+
+    string tmpPath = checkpointPath() + ".tmp";
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    bool ok = fp != nullptr;
+    if (ok) {
+        ok = writeAll(fp, data) && syncFile(fp);
+        fclose(fp);
+    }
+
+    if (ok) {
+#ifdef _WIN32
+        remove(checkpointPath().c_str());
+#endif
+        ok = rename(tmpPath.c_str(), checkpointPath().c_str()) == 0 && syncDir(dir_);
+    }
+
+    lock.lock();
+    if (ok) {
+        // 旧的日志文件不能在写入过程中被替换
+        while (flushing_) {
+            flushed_.wait(lock);
+        }
+        ok = !failed_ && resetLog();
+    }
+
+    if (ok) {
+        logRecords_ = lastLsn_ - snapshotLsn;
+    }
+    checkpointing_ = false;
+    carry_.clear();
+    flushed_.notify_all();
+    return ok;
+}
+
+/**
+ * @brief 用只包含carry_的新日志文件替换旧日志，持有mutex_且没有线程在写日志时调用
+ * 新文件fsync后再rename，崩溃时磁盘上总有一份完整的日志；rename失败时继续追加旧日志
+ */
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::resetLog()
+{
+    string tmpPath = walPath() + ".tmp";
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (fp == nullptr) {
+        return false;
+    }
+
+    bool ok = writeAll(fp, carry_) && syncFile(fp);
+    fclose(fp);
+    if (!ok) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    if (wal_ != nullptr) {
+        fclose(wal_);
+    }
+#ifdef _WIN32
+    remove(walPath().c_str());
+#endif
+    ok = rename(tmpPath.c_str(), walPath().c_str()) == 0 && syncDir(dir_);
+
+    wal_ = fopen(walPath().c_str(), "ab");
+    if (wal_ == nullptr) {
+        failed_ = true;
+        pending_.clear();
+        return false;
+    }
+
+    return ok;
+}
+
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::loadCheckpoint()
+{
+    FILE *fp = fopen(checkpointPath().c_str(), "rb");
+    if (fp == nullptr) {
+        return true; // 还没有做过checkpoint
+    }
+
+    string data;
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        data.append(chunk, n);
+    }
+    fclose(fp);
+
+    const size_t headerSize = sizeof(uint32_t) + sizeof(uint64_t);
+    if (data.size() < headerSize + sizeof(uint32_t)) {
+        return false;
+    }
+
+    uint32_t magic, crc;
+    uint64_t count;
+    memcpy(&magic, data.data(), sizeof(magic));
+    memcpy(&count, data.data() + sizeof(magic), sizeof(count));
+    memcpy(&crc, data.data() + data.size() - sizeof(crc), sizeof(crc));
+
+    const size_t entrySize = sizeof(Key) + sizeof(Value);
+    if (magic != kCheckpointMagic || data.size() != headerSize + count * entrySize + sizeof(crc) ||
+        crc32(data.data(), data.size() - sizeof(crc)) != crc) {
+        return false;
+    }
+
+    const char *p = data.data() + headerSize;
+    for (uint64_t i = 0; i < count; i++) {
+        Key key;
+        Value value;
+        memcpy(&key, p, sizeof(Key));
+        memcpy(&value, p + sizeof(Key), sizeof(Value));
+        tree_.put(key, value);
+        p += entrySize;
+    }
+
+    return true;
+}
+
+/**
+ * @brief 重放日志，返回日志文件的字节数，读取失败返回-1
+ */
+template <class Key, class Value>
+long DurableAVLTree<Key, Value>::replayLog()
+{
+    FILE *fp = fopen(walPath().c_str(), "rb");
+    if (fp == nullptr) {
+        return 0;
+    }
+
+    char record[kRecordSize];
+    while (fread(record, 1, kRecordSize, fp) == kRecordSize) {
+        uint32_t crc;
+        memcpy(&crc, record, sizeof(crc));
+        if (crc32(record + sizeof(uint32_t), kRecordSize - sizeof(uint32_t)) != crc) {
+            break; // 崩溃时写了一半的记录
+        }
+
+        const char *p = record + sizeof(uint32_t);
+        uint8_t op = static_cast<uint8_t>(*p++);
+        Key key;
+        Value value;
+        memcpy(&key, p, sizeof(Key));
+        memcpy(&value, p + sizeof(Key), sizeof(Value));
+
+        if (op == OP_PUT) {
+            tree_.put(key, value);
+        } else if (op == OP_DELETE) {
+            tree_.deleteKey(key);
+        } else {
+            break;
+        }
+    }
+
+    long bytes = -1;
+    if (ferror(fp) == 0 && fseek(fp, 0, SEEK_END) == 0) {
+        bytes = ftell(fp);
+    }
+    fclose(fp);
+    return bytes;
+}
+
+template <class Key, class Value>
+uint32_t DurableAVLTree<Key, Value>::crc32(const char *data, size_t n, uint32_t crc)
+{
+    static uint32_t table[256];
+    static once_flag initialized;
+    call_once(initialized, []() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    });
+
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::syncFile(FILE *fp)
+{
+    if (fflush(fp) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(fp)) == 0;
+#else
+    return fdatasync(fileno(fp)) == 0;
+#endif
+}
+
+/**
+ * @brief rename之后同步目录项，保证新的checkpoint文件名在掉电后仍然可见
+ */
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::syncDir(const string &dir)
+{
+#ifdef _WIN32
+    return true;
+#else
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+template <class Key, class Value>
+bool DurableAVLTree<Key, Value>::writeAll(FILE *fp, const string &data)
+{
+    return data.empty() || fwrite(data.data(), 1, data.size(), fp) == data.size();
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include "DurableAVLTree.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+using namespace std;
+
+/* 数据放在临时目录中，结束时删除 */
+string tempDir(const char *name)
+{
+#ifdef _WIN32
+    const char *tmp = getenv("TEMP");
+#else
+    const char *tmp = getenv("TMPDIR");
+#endif
+    return string(tmp != nullptr ? tmp : "/tmp") + "/" + name;
+}
+
+void removeData(const string &dir)
+{
+    remove((dir + "/wal.log").c_str());
+    remove((dir + "/wal.log.tmp").c_str());
+    remove((dir + "/checkpoint.dat").c_str());
+    remove((dir + "/checkpoint.dat.tmp").c_str());
+}
+
+void writeData(const string &dir)
+{
+    WalOptions options;
+    options.checkpointRecords = 1000;
+
+    DurableAVLTree<int, int> tree(options);
+    tree.open(dir);
+
+    // 四个线程并发写入，fsync由group commit合并
+    vector<thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([&tree, t]() {
+            for (int k = t; k < 2000; k += 4) {
+                tree.put(k, k * 10);
+            }
+        });
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    tree.deleteKey(7);
+    cout << "size before close: " << tree.size() << endl;
+}
+
+void readData(const string &dir)
+{
+    DurableAVLTree<int, int> tree;
+    tree.open(dir);
+
+    int val = 0;
+    cout << "size after recovery: " << tree.size() << endl;
+    cout << "contain(7): " << tree.contain(7) << endl;
+    if (tree.get(1999, val)) {
+        cout << "get(1999): " << val << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    string dir = tempDir("durable_avl_data");
+#ifdef _WIN32
+    mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+    removeData(dir);
+
+    writeData(dir);
+    readData(dir);
+
+    removeData(dir);
+    remove(dir.c_str());
+    return 0;
+}
@@ -0,0 +1,212 @@
+#ifndef __FLATAVLTREE_H_
+#define __FLATAVLTREE_H_
+
+#include <cassert>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include "../AVLTree/AVLTree.h"
+using namespace std;
+
+/**
+ * 小表用有序数组保存，变大后换成AVLTree，对外的接口不变
+ * 1. 扁平模式下键和值分别保存在两个有序数组中，键连续存放，查找只读键数组：
+ *    不超过kLinearSearch个键时统计小于key的键的个数(无分支，可以向量化)，否则二分查找
+ * 2. 键的数量超过PromoteSize时按升序线性时间建成AVLTree(提升)
+ * 3. 树模式下键的数量降到PromoteSize / 2以下时再导出成有序数组(降级)，
+ *    两个阈值之间留有间隔，避免在阈值附近反复转换
+ * 扁平模式下get返回的指针在下一次put/deleteKey之后失效
+ */
+template <class Key, class Value, int PromoteSize = 64>
+class FlatAVLTree {
+public:
+    using MyAVLTree = AVLTree<Key, Value>;
+
+    static_assert(PromoteSize >= 2, "FlatAVLTree requires PromoteSize >= 2");
+
+    FlatAVLTree() = default;
+
+public:
+    int size() { return tree_ != nullptr ? tree_->size() : static_cast<int>(keys_.size()); }
+    bool isEmpty() { return size() == 0; }
+    bool contain(const Key &key) { return get(key) != nullptr; }
+
+    /* 当前是否为扁平模式 */
+    bool isFlat() { return tree_ == nullptr; }
+
+    Value *get(const Key &key);
+    void put(const Key &key, const Value &val);
+    void deleteKey(const Key &key);
+
+    Key minimum();
+    Key maximum();
+
+    void deleteMin() { if (!isEmpty()) deleteKey(minimum()); }
+    void deleteMax() { if (!isEmpty()) deleteKey(maximum()); }
+
+    /* 删除所有键值对，回到扁平模式 */
+    void clear();
+
+    /* 按键的升序访问[lo, hi]之间的所有键值对，fn(key, value) */
+    template <class Func>
+    void forEach(const Key &lo, const Key &hi, Func fn);
+
+private:
+    static const int kLinearSearch = 16;
+    static const int kDemoteSize = PromoteSize / 2;
+
+    /* 第一个不小于key的键的下标 */
+    int lowerBound(const Key &key);
+
+    void promote();
+    void demote();
+
+private:
+    vector<Key> keys_;
+    vector<Value> values_;
+    unique_ptr<MyAVLTree> tree_;
+};
+
+template <class Key, class Value, int PromoteSize>
+int FlatAVLTree<Key, Value, PromoteSize>::lowerBound(const Key &key)
+{
+    int n = static_cast<int>(keys_.size());
+    if (n <= kLinearSearch) {
+        int pos = 0;
+        for (int i = 0; i < n; i++) {
+            pos += keys_[i] < key;
+        }
+        return pos;
+    }
+
+    return static_cast<int>(lower_bound(keys_.begin(), keys_.end(), key) - keys_.begin());
+}
+
+template <class Key, class Value, int PromoteSize>
+Value *FlatAVLTree<Key, Value, PromoteSize>::get(const Key &key)
+{
+    if (tree_ != nullptr) {
+        return tree_->get(key);
+    }
+
+    int pos = lowerBound(key);
+    if (pos == static_cast<int>(keys_.size()) || !(keys_[pos] == key)) {
+        return nullptr;
+    }
+    return &values_[pos];
+}
+
+template <class Key, class Value, int PromoteSize>
+void FlatAVLTree<Key, Value, PromoteSize>::put(const Key &key, const Value &val)
+{
+    if (tree_ != nullptr) {
+        tree_->put(key, val);
+        return;
+    }
+
+    int pos = lowerBound(key);
+    if (pos < static_cast<int>(keys_.size()) && keys_[pos] == key) {
+        values_[pos] = val;
+        return;
+    }
+
+    keys_.insert(keys_.begin() + pos, key);
+    values_.insert(values_.begin() + pos, val);
+    if (static_cast<int>(keys_.size()) > PromoteSize) {
+        promote();
+    }
+}
+
+template <class Key, class Value, int PromoteSize>
+void FlatAVLTree<Key, Value, PromoteSize>::deleteKey(const Key &key)
+{
+    if (tree_ != nullptr) {
+        tree_->deleteKey(key);
+        if (tree_->size() < kDemoteSize) {
+            demote();
+        }
+        return;
+    }
+
+    int pos = lowerBound(key);
+    if (pos < static_cast<int>(keys_.size()) && keys_[pos] == key) {
+        keys_.erase(keys_.begin() + pos);
+        values_.erase(values_.begin() + pos);
+    }
+}
+
+template <class Key, class Value, int PromoteSize>
+Key FlatAVLTree<Key, Value, PromoteSize>::minimum()
+{
+    assert(!isEmpty());
+    return tree_ != nullptr ? tree_->minimum() : keys_.front();
+}
+
+template <class Key, class Value, int PromoteSize>
+Key FlatAVLTree<Key, Value, PromoteSize>::maximum()
+{
+    assert(!isEmpty());
+    return tree_ != nullptr ? tree_->maximum() : keys_.back();
+}
+
+template <class Key, class Value, int PromoteSize>
+void FlatAVLTree<Key, Value, PromoteSize>::clear()
+{
+    tree_.reset();
+    keys_.clear();
+    values_.clear();
+}
+
+template <class Key, class Value, int PromoteSize>
+template <class Func>
+void FlatAVLTree<Key, Value, PromoteSize>::forEach(const Key &lo, const Key &hi, Func fn)
+{
+    if (tree_ != nullptr) {
+        tree_->forEach(lo, hi, fn);
+        return;
+    }
+
+    int n = static_cast<int>(keys_.size());
+    for (int i = lowerBound(lo); i < n && !(hi < keys_[i]); i++) {
+        fn(keys_[i], values_[i]);
+    }
+}
+
+/**
+ * @brief 有序数组中的键已经按升序排列，直接线性时间建树，然后释放数组
+ */
+template <class Key, class Value, int PromoteSize>
+void FlatAVLTree<Key, Value, PromoteSize>::promote()
+{
+    vector<pair<Key, Value>> items;
+    items.reserve(keys_.size());
+    for (size_t i = 0; i < keys_.size(); i++) {
+        items.emplace_back(keys_[i], values_[i]);
+    }
+
+    tree_.reset(new MyAVLTree());
+    tree_->buildSorted(items.begin(), items.end());
+
+    vector<Key>().swap(keys_);
+    vector<Value>().swap(values_);
+}
+
+/**
+ * @brief 按中序导出到有序数组，然后释放整棵树
+ */
+template <class Key, class Value, int PromoteSize>
+void FlatAVLTree<Key, Value, PromoteSize>::demote()
+{
+    keys_.reserve(PromoteSize);
+    values_.reserve(PromoteSize);
+    if (!tree_->isEmpty()) {
+        tree_->forEach(tree_->minimum(), tree_->maximum(), [this](const Key &key, const Value &val) {
+            keys_.push_back(key);
+            values_.push_back(val);
+        });
+    }
+    tree_.reset();
+}
+
+#endif
@@ -0,0 +1,34 @@
+#include "FlatAVLTree.h"
+
+#include <iostream>
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    FlatAVLTree<int, int, 8> table;
+
+    for (int i = 0; i < 6; i++) {
+        table.put(i * 10, i);
+    }
+    cout << "size: " << table.size() << ", flat: " << table.isFlat() << endl;
+
+    for (int i = 6; i < 12; i++) {
+        table.put(i * 10, i);
+    }
+    cout << "size: " << table.size() << ", flat: " << table.isFlat() << endl;
+
+    for (int i = 0; i < 9; i++) {
+        table.deleteMin();
+    }
+    cout << "size: " << table.size() << ", flat: " << table.isFlat() << endl;
+
+    table.forEach(0, 200, [](const int &key, const int &val) {
+        cout << "(" << key << ", " << val << ") ";
+    });
+    cout << endl;
+
+    cout << "get(100): " << *table.get(100) << endl;
+    cout << "contain(50): " << table.contain(50) << endl;
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+#ifndef __HASHINDEXEDAVLTREE_H_
+#define __HASHINDEXEDAVLTREE_H_
+
+#include <cassert>
+#include <vector>
+#include "../AVLTree/AVLTree.h"
+#include "../tree_cache.h"
+using namespace std;
+
+/**
+ * 同时用哈希表和AVLTree索引的表，点操作多、有序查询少时使用
+ * 1. KeyIndex保存键到树结点中值的地址，get和更新已有键的put只需一次哈希探测，不下降
+ * 2. 插入新键和有序查询(最小最大、范围遍历、范围删除)仍然由树完成
+ * 3. AVLTree删除结点时不移动其它结点，值的地址在键被删除之前一直有效，
+ *    每次put/delete都同步KeyIndex，两个索引始终一致；AVLTree::shrink()会搬动结点，
+ *    使KeyIndex中的地址全部失效，所以这里不提供shrink
+ * 代价是每个键在哈希表中多保存一份键和一个指针
+ */
+template <class Key, class Value, class Hash = hash<Key>>
+class HashIndexedAVLTree {
+public:
+    using MyAVLTree = AVLTree<Key, Value>;
+
+    HashIndexedAVLTree() : index_(&CountingBloomFilter<Key>::template hashWith<Hash>) {}
+
+    HashIndexedAVLTree(const HashIndexedAVLTree &) = delete;
+    HashIndexedAVLTree &operator=(const HashIndexedAVLTree &) = delete;
+
+public:
+    int size() { return tree_.size(); }
+    bool isEmpty() { return tree_.isEmpty(); }
+    bool contain(const Key &key) { return index_.find(key) != nullptr; }
+
+    Value *get(const Key &key) { return index_.find(key); }
+    void put(const Key &key, const Value &val);
+    void deleteKey(const Key &key);
+
+    Key minimum() { return tree_.minimum(); }
+    Key maximum() { return tree_.maximum(); }
+
+    void deleteMin() { if (!isEmpty()) deleteKey(tree_.minimum()); }
+    void deleteMax() { if (!isEmpty()) deleteKey(tree_.maximum()); }
+
+    /* 删除[lo, hi]之间的所有键，返回删除的个数 */
+    int deleteRange(const Key &lo, const Key &hi);
+
+    void clear();
+
+    /* 按键的升序访问[lo, hi]之间的所有键值对，fn(key, value) */
+    template <class Func>
+    void forEach(const Key &lo, const Key &hi, Func fn) { tree_.forEach(lo, hi, fn); }
+
+    /* 树和哈希表一共占用的内存 */
+    TreeMemoryUsage memoryUsage();
+
+private:
+    MyAVLTree tree_;
+    KeyIndex<Key, Value> index_;
+};
+
+template <class Key, class Value, class Hash>
+void HashIndexedAVLTree<Key, Value, Hash>::put(const Key &key, const Value &val)
+{
+    Value *slot = index_.find(key);
+    if (slot != nullptr) {
+        *slot = val;
+        return;
+    }
+
+    index_.insert(key, tree_.put(key, val));
+}
+
+/**
+ * @brief 哈希表中没有的键不需要下降到树中
+ */
+template <class Key, class Value, class Hash>
+void HashIndexedAVLTree<Key, Value, Hash>::deleteKey(const Key &key)
+{
+    if (index_.find(key) == nullptr) {
+        return;
+    }
+
+    index_.erase(key);
+    tree_.deleteKey(key);
+}
+
+template <class Key, class Value, class Hash>
+int HashIndexedAVLTree<Key, Value, Hash>::deleteRange(const Key &lo, const Key &hi)
+{
+    if (isEmpty() || hi < lo) {
+        return 0;
+    }
+
+    tree_.forEach(lo, hi, [this](const Key &key, const Value &) { index_.erase(key); });
+    return tree_.deleteRange(lo, hi);
+}
+
+template <class Key, class Value, class Hash>
+void HashIndexedAVLTree<Key, Value, Hash>::clear()
+{
+    tree_.clear();
+    index_.clear();
+}
+
+template <class Key, class Value, class Hash>
+TreeMemoryUsage HashIndexedAVLTree<Key, Value, Hash>::memoryUsage()
+{
+    TreeMemoryUsage usage = tree_.memoryUsage();
+    usage.auxiliaryBytes += index_.memoryUsage();
+    return usage;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#include "HashIndexedAVLTree.h"
+
+#include <iostream>
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    HashIndexedAVLTree<int, int> table;
+
+    for (int i = 0; i < 100; i++) {
+        table.put(i, i * 10);
+    }
+    table.put(42, -1);
+
+    cout << "size: " << table.size() << endl;
+    cout << "get(42): " << *table.get(42) << endl;
+
+    table.deleteKey(50);
+    cout << "contain(50): " << table.contain(50) << endl;
+
+    cout << "deleteRange(10, 89): " << table.deleteRange(10, 89) << endl;
+    table.forEach(0, 100, [](const int &key, const int &val) {
+        cout << "(" << key << ", " << val << ") ";
+    });
+    cout << endl;
+
+    cout << "MIN: " << table.minimum() << ", MAX: " << table.maximum() << endl;
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+#ifndef __INTERVALTREE_H_
+#define __INTERVALTREE_H_
+
+#include <vector>
+#include <utility>
+#include "../AVLTree/AVLTree.h"
+using namespace std;
+
+/**
+ * 闭区间[low, high]，按(low, high)的字典序比较，作为AVLTree的键
+ */
+template <class T>
+struct Interval {
+    T low;
+    T high;
+
+    Interval() : low(), high() {}
+    Interval(const T &low, const T &high) : low(low), high(high) {}
+
+    bool overlaps(const T &lo, const T &hi) const { return !(high < lo) && !(hi < low); }
+};
+
+template <class T>
+bool operator<(const Interval<T> &a, const Interval<T> &b)
+{
+    return a.low < b.low || (!(b.low < a.low) && a.high < b.high);
+}
+
+template <class T>
+bool operator>(const Interval<T> &a, const Interval<T> &b) { return b < a; }
+
+template <class T>
+bool operator==(const Interval<T> &a, const Interval<T> &b) { return !(a < b) && !(b < a); }
+
+template <class T>
+ostream &operator<<(ostream &os, const Interval<T> &interval)
+{
+    return os << "[" << interval.low << ", " << interval.high << "]";
+}
+
+/**
+ * 每个结点记录子树中所有区间右端点的最大值maxHigh，
+ * 由AVLTree在旋转、rebalance、插入和删除时通过update维护
+ */
+template <class T>
+struct IntervalMaxUpdate {
+    struct metadata {
+        T maxHigh;
+    };
+
+    template <class Node>
+    static void update(Node *x) {
+        x->maxHigh = x->key.high;
+        if (x->left != nullptr && x->maxHigh < x->left->maxHigh) {
+            x->maxHigh = x->left->maxHigh;
+        }
+        if (x->right != nullptr && x->maxHigh < x->right->maxHigh) {
+            x->maxHigh = x->right->maxHigh;
+        }
+    }
+};
+
+/**
+ * 区间树：以区间左端点排序的AVL树，结点附加子树的最大右端点
+ * 1. 子树的maxHigh < lo时，子树中没有与[lo, hi]相交的区间，整棵子树跳过
+ * 2. 结点的low > hi时，它和右子树的区间都在hi的右侧，右子树跳过
+ * 查询只访问与结果相关的路径，代价为O(min(n, (k + 1) * log n))，k为结果数量
+ */
+template <class T, class Value>
+class IntervalTree : public AVLTree<Interval<T>, Value, IntervalMaxUpdate<T>> {
+public:
+    using MyInterval = Interval<T>;
+    using MyAVLTree = AVLTree<MyInterval, Value, IntervalMaxUpdate<T>>;
+    using MyAVLTreeNode = typename MyAVLTree::MyAVLTreeNode;
+
+    void put(const T &low, const T &high, const Value &val) { MyAVLTree::put(MyInterval(low, high), val); }
+    Value *get(const T &low, const T &high) { return MyAVLTree::get(MyInterval(low, high)); }
+    void deleteKey(const T &low, const T &high) { MyAVLTree::deleteKey(MyInterval(low, high)); }
+
+public:
+    /* 按左端点的升序访问与[lo, hi]相交的所有区间，fn(interval, value) */
+    template <class Func>
+    void forEachOverlap(const T &lo, const T &hi, Func fn) { forEachOverlap(this->root_, lo, hi, fn); }
+
+    /* 与[lo, hi]相交的所有区间 */
+    vector<pair<MyInterval, Value>> overlap(const T &lo, const T &hi);
+
+    /* 包含点p的所有区间 */
+    vector<pair<MyInterval, Value>> stab(const T &p) { return overlap(p, p); }
+
+    /* 是否存在与[lo, hi]相交的区间，O(log n) */
+    bool anyOverlap(const T &lo, const T &hi);
+
+private:
+    template <class Func>
+    void forEachOverlap(MyAVLTreeNode *x, const T &lo, const T &hi, Func &fn);
+};
+
+template <class T, class Value>
+template <class Func>
+void IntervalTree<T, Value>::forEachOverlap(MyAVLTreeNode *x, const T &lo, const T &hi, Func &fn)
+{
+    if (x == nullptr || x->maxHigh < lo) {
+        return;
+    }
+
+    forEachOverlap(x->left, lo, hi, fn);
+
+    if (hi < x->key.low) {
+        return;
+    }
+
+    if (x->key.overlaps(lo, hi)) {
+        fn(x->key, x->value);
+    }
+
+    forEachOverlap(x->right, lo, hi, fn);
+}
+
+template <class T, class Value>
+vector<pair<typename IntervalTree<T, Value>::MyInterval, Value>>
+IntervalTree<T, Value>::overlap(const T &lo, const T &hi)
+{
+    vector<pair<MyInterval, Value>> result;
+    forEachOverlap(lo, hi, [&result](const MyInterval &interval, const Value &value) {
+        result.emplace_back(interval, value);
+    });
+
+    return result;
+}
+
+/**
+ * 左子树的maxHigh >= lo时，若左子树中没有相交的区间，
+ * 则左子树所有区间的low都大于hi，右子树更不可能相交，因此每层只需进入一侧
+ */
+template <class T, class Value>
+bool IntervalTree<T, Value>::anyOverlap(const T &lo, const T &hi)
+{
+    MyAVLTreeNode *x = this->root_;
+    while (x != nullptr) {
+        if (x->key.overlaps(lo, hi)) {
+            return true;
+        }
+
+        if (x->left != nullptr && !(x->left->maxHigh < lo)) {
+            x = x->left;
+        } else {
+            x = x->right;
+        }
+    }
+
+    return false;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#include "IntervalTree.h"
+
+#include <iostream>
+using namespace std;
+
+void initIntervalTree(IntervalTree<int, int> &tree)
+{
+    tree.put(15, 20, 1);
+    tree.put(10, 30, 2);
+    tree.put(17, 19, 3);
+    tree.put(5, 20, 4);
+    tree.put(12, 15, 5);
+    tree.put(30, 40, 6);
+}
+
+int main(int argc, char **argv)
+{
+    IntervalTree<int, int> tree;
+
+    initIntervalTree(tree);
+    tree.inOrder();
+    cout << endl;
+
+    cout << "overlap [6, 7]:" << endl;
+    for (auto &item : tree.overlap(6, 7)) {
+        cout << item.first << " -> " << item.second << endl;
+    }
+
+    cout << "stab 18:" << endl;
+    for (auto &item : tree.stab(18)) {
+        cout << item.first << " -> " << item.second << endl;
+    }
+
+    tree.deleteKey(10, 30);
+    cout << "any overlap [21, 29]: " << tree.anyOverlap(21, 29) << endl;
+    cout << "any overlap [21, 30]: " << tree.anyOverlap(21, 30) << endl;
+
+    return 0;
+}
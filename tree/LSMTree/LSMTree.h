@@ -0,0 +1,862 @@
+#ifndef __LSMTREE_H_
+#define __LSMTREE_H_
+
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <type_traits>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "../AVLTree/AVLTree.h"
+using namespace std;
+
+struct LSMOptions {
+    /* memtable中的键值对达到该数量后冻结并写成一个有序的run文件 */
+    int memtableEntries = 1 << 16;
+
+    /**
+     * 分层(size-tiered)合并的扇出：run按大小分层，第t层的run不超过memtableEntries * maxRuns^t条，
+     * 相邻的maxRuns个同层run由后台线程合并成一个上一层的run
+     */
+    int maxRuns = 4;
+};
+
+/**
+ * 以AVLTree为memtable的LSM(log-structured merge)存储
+ * 1. 写操作只修改memtable，删除写入一个墓碑(tombstone)
+ * 2. memtable写满后冻结为只读的immutable memtable，由后台线程按顺序写成run文件，
+ *    写文件期间前台在新的memtable上继续写入
+ * 3. run文件一旦写完就不再修改，后台线程把相邻的同层run做k路归并(compaction)，
+ *    每条记录只在升层时被重写，总共O(log n)次；合并包含最旧的run时墓碑和被覆盖的旧值一起丢弃
+ * 4. 点查询依次查memtable、immutable memtable和由新到旧的run，遇到的第一个版本即为结果；
+ *    范围查询对所有来源做k路归并，同一个键只取最新的版本
+ * 5. MANIFEST文件记录当前有效的run，通过临时文件 + rename原子替换；
+ *    runs_只由后台线程修改，它在锁外写MANIFEST并fsync，之后才在锁内换上新的run列表
+ * memtable中的数据只在内存中，进程崩溃时会丢失，close时写成run文件
+ * 键和值按内存布局写入文件，因此必须是trivially copyable的类型
+ */
+template <class Key, class Value>
+class LSMTree {
+public:
+    static_assert(is_trivially_copyable<Key>::value, "Key must be trivially copyable");
+    static_assert(is_trivially_copyable<Value>::value, "Value must be trivially copyable");
+
+    explicit LSMTree(const LSMOptions &options = LSMOptions());
+    ~LSMTree();
+
+    LSMTree(const LSMTree &) = delete;
+    LSMTree &operator=(const LSMTree &) = delete;
+
+public:
+    /* 打开目录dir下的数据，并启动后台线程 */
+    bool open(const string &dir);
+    void close();
+
+    /* 删除目录dir下MANIFEST记录的所有run文件和MANIFEST本身，目录不能处于打开状态 */
+    static void destroy(const string &dir);
+
+    bool contain(const Key &key);
+    bool get(const Key &key, Value &val);
+    void put(const Key &key, const Value &val) { write(key, &val); }
+    void deleteKey(const Key &key) { write(key, nullptr); }
+
+    /* 按键的升序访问[lo, hi]之间的所有键值对，fn(key, value) */
+    template <class Func>
+    void forEach(const Key &lo, const Key &hi, Func fn);
+
+    /* 把当前的memtable写成run文件，并等待后台线程完成 */
+    void flush();
+
+    /* 把所有run合并成一个，并等待完成 */
+    void compact();
+
+    int runCount();
+
+private:
+    struct Entry {
+        Value value;
+        bool deleted;
+    };
+
+    using Memtable = AVLTree<Key, Entry>;
+
+    static const size_t kRecordSize = sizeof(Key) + sizeof(Value) + 1;
+    static const int kIndexInterval = 64; // 每64条记录在内存中保存一个索引键
+
+    /**
+     * 一个不可修改的有序run文件，内存中只保存稀疏索引
+     */
+    struct Run {
+        uint64_t id;
+        string path;
+        FILE *fp;
+        uint64_t count;
+        vector<Key> fences; // fences[i]是第i * kIndexInterval条记录的键
+        mutex lock;         // 保护fp的读取位置
+        bool obsolete;      // 被合并掉的run，最后一个引用释放时删除文件
+
+        Run() : id(0), fp(nullptr), count(0), obsolete(false) {}
+        ~Run() {
+            if (fp != nullptr) {
+                fclose(fp);
+            }
+            if (obsolete) {
+                remove(path.c_str());
+            }
+        }
+
+        bool read(uint64_t first, uint64_t n, char *buf);
+        uint64_t lowerBound(const Key &key);
+        bool get(const Key &key, Entry &entry);
+    };
+
+    using RunPtr = shared_ptr<Run>;
+
+    /**
+     * 有序数据源上的游标，k路归并时按键的顺序逐个取出
+     */
+    struct Cursor {
+        virtual ~Cursor() {}
+        virtual bool valid() = 0;
+        virtual const Key &key() = 0;
+        virtual const Entry &entry() = 0;
+        virtual void next() = 0;
+    };
+
+    struct VectorCursor;
+    struct RunCursor;
+
+    /**
+     * 对多个游标做k路归并，键相同时只保留下标最小(最新)的来源
+     */
+    class MergeIterator {
+    public:
+        explicit MergeIterator(vector<unique_ptr<Cursor>> &cursors);
+
+        bool valid() { return !heap_.empty(); }
+        const Key &key() { return cursors_[heap_.top().second]->key(); }
+        const Entry &entry() { return cursors_[heap_.top().second]->entry(); }
+        void next();
+
+    private:
+        struct Greater {
+            bool operator()(const pair<Key, int> &a, const pair<Key, int> &b) const {
+                return b.first < a.first || (!(a.first < b.first) && a.second > b.second);
+            }
+        };
+
+        void push(int i);
+
+        vector<unique_ptr<Cursor>> &cursors_;
+        priority_queue<pair<Key, int>, vector<pair<Key, int>>, Greater> heap_;
+    };
+
+    void write(const Key &key, const Value *val);
+    void freezeLocked(unique_lock<mutex> &lock);
+
+    void backgroundLoop();
+    RunPtr writeRun(MergeIterator &it, bool dropTombstones);
+    bool pickCompaction(size_t &first, size_t &last);
+    bool compactRuns(size_t first, size_t last);
+    int tierOf(uint64_t count);
+
+    RunPtr openRun(uint64_t id);
+    bool saveManifest(const vector<RunPtr> &runs);
+
+    string runPath(uint64_t id) { return dir_ + "/run_" + to_string(id) + ".sst"; }  // 与destroy一致
+    string manifestPath() { return dir_ + "/MANIFEST"; }
+
+    static bool syncFile(FILE *fp);
+
+private:
+    LSMOptions options_;
+    string dir_;
+
+    mutex mutex_;
+    condition_variable work_;      // 唤醒后台线程
+    condition_variable done_;      // 后台线程完成一次flush或compaction
+    unique_ptr<Memtable> memtable_;
+    unique_ptr<Memtable> immutable_;
+    vector<RunPtr> runs_;          // 由新到旧，只有后台线程修改
+    uint64_t nextRunId_;
+    bool compactRequested_;
+    bool failed_;                  // 写run文件失败后不再冻结memtable，数据留在内存中
+    bool stopping_;
+    bool opened_;
+
+    thread background_;
+};
+
+template <class Key, class Value>
+LSMTree<Key, Value>::LSMTree(const LSMOptions &options)
+{
+    options_ = options;
+    memtable_.reset(new Memtable());
+    nextRunId_ = 1;
+    compactRequested_ = false;
+    failed_ = false;
+    stopping_ = false;
+    opened_ = false;
+}
+
+template <class Key, class Value>
+LSMTree<Key, Value>::~LSMTree()
+{
+    close();
+}
+
+template <class Key, class Value>
+bool LSMTree<Key, Value>::open(const string &dir)
+{
+    assert(!opened_);
+    dir_ = dir;
+
+    FILE *fp = fopen(manifestPath().c_str(), "rb");
+    if (fp != nullptr) {
+        unsigned long long id;
+        while (fscanf(fp, "%llu", &id) == 1) {
+            RunPtr run = openRun(id);
+            if (run == nullptr) {
+                fclose(fp);
+                return false;
+            }
+            runs_.push_back(run);
+            nextRunId_ = max(nextRunId_, static_cast<uint64_t>(id) + 1);
+        }
+        fclose(fp);
+    }
+
+    opened_ = true;
+    stopping_ = false;
+    background_ = thread(&LSMTree::backgroundLoop, this);
+    return true;
+}
+
+template <class Key, class Value>
+void LSMTree<Key, Value>::close()
+{
+    if (!opened_) {
+        return;
+    }
+
+    flush();
+    {
+        lock_guard<mutex> guard(mutex_);
+        stopping_ = true;
+    }
+    work_.notify_all();
+    background_.join();
+
+    runs_.clear();
+    opened_ = false;
+}
+
+template <class Key, class Value>
+void LSMTree<Key, Value>::destroy(const string &dir)
+{
+    string manifest = dir + "/MANIFEST";
+    FILE *fp = fopen(manifest.c_str(), "rb");
+    if (fp != nullptr) {
+        unsigned long long id;
+        while (fscanf(fp, "%llu", &id) == 1) {
+            remove((dir + "/run_" + to_string(id) + ".sst").c_str());
+        }
+        fclose(fp);
+    }
+
+    remove(manifest.c_str());
+    remove((manifest + ".tmp").c_str());
+}
+
+template <class Key, class Value>
+void LSMTree<Key, Value>::write(const Key &key, const Value *val)
+{
+    unique_lock<mutex> lock(mutex_);
+
+    Entry entry;
+    entry.deleted = val == nullptr;
+    if (val != nullptr) {
+        entry.value = *val;
+    } else {
+        memset(&entry.value, 0, sizeof(Value));
+    }
+    memtable_->put(key, entry);
+
+    if (memtable_->size() >= options_.memtableEntries) {
+        freezeLocked(lock);
+    }
+}
+
+/**
+ * @brief 冻结当前的memtable，上一个immutable memtable还没有写完时等待(写入限流)
+ */
+template <class Key, class Value>
+void LSMTree<Key, Value>::freezeLocked(unique_lock<mutex> &lock)
+{
+    done_.wait(lock, [this]() { return immutable_ == nullptr || failed_; });
+    if (failed_ || memtable_->isEmpty()) {
+        return;
+    }
+
+    immutable_ = move(memtable_);
+    memtable_.reset(new Memtable());
+    work_.notify_all();
+}
+
+template <class Key, class Value>
+bool LSMTree<Key, Value>::get(const Key &key, Value &val)
+{
+    Entry entry;
+    vector<RunPtr> runs;
+    {
+        lock_guard<mutex> guard(mutex_);
+
+        Entry *found = memtable_->get(key);
+        if (found == nullptr && immutable_ != nullptr) {
+            found = immutable_->get(key);
+        }
+        if (found != nullptr) {
+            if (found->deleted) {
+                return false;
+            }
+            val = found->value;
+            return true;
+        }
+
+        runs = runs_;
+    }
+
+    for (auto &run : runs) {
+        if (run->get(key, entry)) {
+            if (entry.deleted) {
+                return false;
+            }
+            val = entry.value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template <class Key, class Value>
+bool LSMTree<Key, Value>::contain(const Key &key)
+{
+    Value val;
+    return get(key, val);
+}
+
+template <class Key, class Value>
+int LSMTree<Key, Value>::runCount()
+{
+    lock_guard<mutex> guard(mutex_);
+    return static_cast<int>(runs_.size());
+}
+
+template <class Key, class Value>
+void LSMTree<Key, Value>::flush()
+{
+    unique_lock<mutex> lock(mutex_);
+    freezeLocked(lock);
+    done_.wait(lock, [this]() { return immutable_ == nullptr || failed_; });
+}
+
+template <class Key, class Value>
+void LSMTree<Key, Value>::compact()
+{
+    unique_lock<mutex> lock(mutex_);
+    compactRequested_ = true;
+    work_.notify_all();
+    done_.wait(lock, [this]() { return !compactRequested_ || failed_; });
+}
+
+/**
+ * memtable中的数据先在锁内复制出[lo, hi]的部分，run不可修改，只需持有引用，
+ * 之后的归并在锁外进行
+ */
+template <class Key, class Value>
+struct LSMTree<Key, Value>::VectorCursor : public Cursor {
+    vector<pair<Key, Entry>> items;
+    size_t pos = 0;
+
+    bool valid() override { return pos < items.size(); }
+    const Key &key() override { return items[pos].first; }
+    const Entry &entry() override { return items[pos].second; }
+    void next() override { pos++; }
+};
+
+/**
+ * 从run的某个位置开始顺序读取，每次读入一个索引区间的记录
+ */
+template <class Key, class Value>
+struct LSMTree<Key, Value>::RunCursor : public Cursor {
+    RunPtr run;
+    uint64_t pos;
+    uint64_t bufferStart;
+    uint64_t bufferCount;
+    vector<char> buffer;
+    Key curKey;
+    Entry curEntry;
+
+    RunCursor(const RunPtr &run, uint64_t pos)
+        : run(run), pos(pos), bufferStart(0), bufferCount(0), buffer(kRecordSize * kIndexInterval) {
+        load();
+    }
+
+    void load() {
+        if (pos >= run->count) {
+            return;
+        }
+        if (pos < bufferStart || pos >= bufferStart + bufferCount) {
+            bufferStart = pos;
+            bufferCount = min<uint64_t>(kIndexInterval, run->count - pos);
+            if (!run->read(bufferStart, bufferCount, buffer.data())) {
+                pos = run->count;
+                return;
+            }
+        }
+
+        const char *p = buffer.data() + (pos - bufferStart) * kRecordSize;
+        memcpy(&curKey, p, sizeof(Key));
+        memcpy(&curEntry.value, p + sizeof(Key), sizeof(Value));
+        curEntry.deleted = p[sizeof(Key) + sizeof(Value)] != 0;
+    }
+
+    bool valid() override { return pos < run->count; }
+    const Key &key() override { return curKey; }
+    const Entry &entry() override { return curEntry; }
+    void next() override { pos++; load(); }
+};
+
+template <class Key, class Value>
+template <class Func>
+void LSMTree<Key, Value>::forEach(const Key &lo, const Key &hi, Func fn)
+{
+    if (hi < lo) {
+        return;
+    }
+
+    vector<unique_ptr<Cursor>> cursors;
+    {
+        lock_guard<mutex> guard(mutex_);
+
+        Memtable *memtables[] = {memtable_.get(), immutable_.get()};
+        for (Memtable *memtable : memtables) {
+            if (memtable == nullptr) {
+                continue;
+            }
+
+            VectorCursor *cursor = new VectorCursor();
+            memtable->forEach(lo, hi, [cursor](const Key &key, const Entry &entry) {
+                cursor->items.emplace_back(key, entry);
+            });
+            cursors.emplace_back(cursor);
+        }
+
+        for (auto &run : runs_) {
+            cursors.emplace_back(new RunCursor(run, run->lowerBound(lo)));
+        }
+    }
+
+    for (MergeIterator it(cursors); it.valid(); it.next()) {
+        if (hi < it.key()) {
+            break;
+        }
+        if (!it.entry().deleted) {
+            fn(it.key(), it.entry().value);
+        }
+    }
+}
+
+template <class Key, class Value>
+LSMTree<Key, Value>::MergeIterator::MergeIterator(vector<unique_ptr<Cursor>> &cursors)
+    : cursors_(cursors)
+{
+    for (size_t i = 0; i < cursors_.size(); i++) {
+        push(static_cast<int>(i));
+    }
+}
+
+template <class Key, class Value>
+void LSMTree<Key, Value>::MergeIterator::push(int i)
+{
+    if (cursors_[i]->valid()) {
+        heap_.push(make_pair(cursors_[i]->key(), i));
+    }
+}
+
+/**
+ * 弹出当前的键，并跳过较旧来源中相同的键
+ */
+template <class Key, class Value>
+void LSMTree<Key, Value>::MergeIterator::next()
+{
+    Key current = heap_.top().first;
+
+    while (!heap_.empty() && !(current < heap_.top().first)) {
+        int i = heap_.top().second;
+        heap_.pop();
+        cursors_[i]->next();
+        push(i);
+    }
+}
+
+template <class Key, class Value>
+bool LSMTree<Key, Value>::Run::read(uint64_t first, uint64_t n, char *buf)
+{
+    lock_guard<mutex> guard(lock);
+
+    long offset = static_cast<long>(sizeof(uint64_t) + first * kRecordSize);
+    if (fseek(fp, offset, SEEK_SET) != 0) {
+        return false;
+    }
+
+    return fread(buf, kRecordSize, n, fp) == n;
+}
+
+/**
+ * @brief 第一个>=key的记录的位置，先在稀疏索引中二分，再读一个索引区间
+ */
+template <class Key, class Value>
+uint64_t LSMTree<Key, Value>::Run::lowerBound(const Key &key)
+{
+    size_t block = upper_bound(fences.begin(), fences.end(), key) - fences.begin();
+    if (block == 0) {
+        return 0;
+    }
+    block--;
+
+    uint64_t first = block * kIndexInterval;
+    uint64_t n = min<uint64_t>(kIndexInterval, count - first);
+    char buf[kRecordSize * kIndexInterval];
+    if (!read(first, n, buf)) {
+        return count;
+    }
+
+    for (uint64_t i = 0; i < n; i++) {
+        Key k;
+        memcpy(&k, buf + i * kRecordSize, sizeof(Key));
+        if (!(k < key)) {
+            return first + i;
+        }
+    }
+    return first + n;
+}
+
+template <class Key, class Value>
+bool LSMTree<Key, Value>::Run::get(const Key &key, Entry &entry)
+{
+    if (count == 0 || key < fences.front()) {
+        return false;
+    }
+
+    uint64_t pos = lowerBound(key);
+    if (pos >= count) {
+        return false;
+    }
+
+    char buf[kRecordSize];
+    if (!read(pos, 1, buf)) {
+        return false;
+    }
+
+    Key k;
+    memcpy(&k, buf, sizeof(Key));
+    if (key < k) {
+        return false;
+    }
+
+    memcpy(&entry.value, buf + sizeof(Key), sizeof(Value));
+    entry.deleted = buf[sizeof(Key) + sizeof(Value)] != 0;
+    return true;
+}
+
+/**
+ * run文件: | count | (key, value, deleted) * count |
+ */
+template <class Key, class Value>
+typename LSMTree<Key, Value>::RunPtr
+LSMTree<Key, Value>::openRun(uint64_t id)
+{
+    RunPtr run(new Run());
+    run->id = id;
+    run->path = runPath(id);
+    run->fp = fopen(run->path.c_str(), "rb");
+    if (run->fp == nullptr || fread(&run->count, sizeof(run->count), 1, run->fp) != 1) {
+        return nullptr;
+    }
+
+    char record[kRecordSize];
+    for (uint64_t i = 0; i < run->count; i++) {
+        if (fread(record, kRecordSize, 1, run->fp) != 1) {
+            return nullptr;
+        }
+        if (i % kIndexInterval == 0) {
+            Key key;
+            memcpy(&key, record, sizeof(Key));
+            run->fences.push_back(key);
+        }
+    }
+
+    return run;
+}
+
+/**
+ * @brief 把归并结果顺序写成一个新的run文件
+ */
+template <class Key, class Value>
+typename LSMTree<Key, Value>::RunPtr
+LSMTree<Key, Value>::writeRun(MergeIterator &it, bool dropTombstones)
+{
+    uint64_t id;
+    {
+        lock_guard<mutex> guard(mutex_);
+        id = nextRunId_++;
+    }
+
+    string path = runPath(id);
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr) {
+        return nullptr;
+    }
+
+    vector<char> ioBuffer(1 << 20);
+    setvbuf(fp, ioBuffer.data(), _IOFBF, ioBuffer.size());
+
+    uint64_t count = 0;
+    fwrite(&count, sizeof(count), 1, fp);
+
+    char record[kRecordSize];
+    for (; it.valid(); it.next()) {
+        const Entry &entry = it.entry();
+        if (dropTombstones && entry.deleted) {
+            continue;
+        }
+
+        memcpy(record, &it.key(), sizeof(Key));
+        memcpy(record + sizeof(Key), &entry.value, sizeof(Value));
+        record[sizeof(Key) + sizeof(Value)] = entry.deleted ? 1 : 0;
+        fwrite(record, kRecordSize, 1, fp);
+        count++;
+    }
+
+    bool ok = fseek(fp, 0, SEEK_SET) == 0 && fwrite(&count, sizeof(count), 1, fp) == 1 && syncFile(fp);
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        remove(path.c_str());
+        return nullptr;
+    }
+
+    return openRun(id);
+}
+
+template <class Key, class Value>
+bool LSMTree<Key, Value>::saveManifest(const vector<RunPtr> &runs)
+{
+    string tmpPath = manifestPath() + ".tmp";
+    FILE *fp = fopen(tmpPath.c_str(), "w");
+    if (fp == nullptr) {
+        return false;
+    }
+
+    for (auto &run : runs) {
+        fprintf(fp, "%llu\n", static_cast<unsigned long long>(run->id));
+    }
+
+    bool ok = syncFile(fp);
+    ok = fclose(fp) == 0 && ok;
+
+#ifdef _WIN32
+    remove(manifestPath().c_str());
+#endif
+    return ok && rename(tmpPath.c_str(), manifestPath().c_str()) == 0;
+}
+
+/**
+ * @brief run所在的层：第t层的run不超过memtableEntries * maxRuns^t条
+ */
+template <class Key, class Value>
+int LSMTree<Key, Value>::tierOf(uint64_t count)
+{
+    uint64_t fanout = static_cast<uint64_t>(max(options_.maxRuns, 2));
+    uint64_t limit = static_cast<uint64_t>(max(options_.memtableEntries, 1));
+    int tier = 0;
+    while (count > limit) {
+        limit *= fanout;
+        tier++;
+    }
+    return tier;
+}
+
+/**
+ * @brief 从新到旧找第一段至少maxRuns个相邻的同层run，得到runs_[first, last]，持有mutex_或在后台线程中调用
+ * 只合并相邻的run，同一个键的新旧顺序在合并前后不变
+ */
+template <class Key, class Value>
+bool LSMTree<Key, Value>::pickCompaction(size_t &first, size_t &last)
+{
+    size_t fanout = static_cast<size_t>(max(options_.maxRuns, 2));
+    for (size_t i = 0; i < runs_.size(); ) {
+        int tier = tierOf(runs_[i]->count);
+        size_t j = i;
+        while (j + 1 < runs_.size() && tierOf(runs_[j + 1]->count) == tier) {
+            j++;
+        }
+        if (j - i + 1 >= fanout) {
+            first = i;
+            last = j;
+            return true;
+        }
+        i = j + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief 合并runs_[first, last]，在后台线程中调用；合并包含最旧的run时丢弃墓碑
+ * 合并期间前台只会在runs_的前面插入新的run，这一段在列表中的位置整体后移
+ */
+template <class Key, class Value>
+bool LSMTree<Key, Value>::compactRuns(size_t first, size_t last)
+{
+    vector<RunPtr> inputs(runs_.begin() + first, runs_.begin() + last + 1);
+    bool dropTombstones = last + 1 == runs_.size();
+
+    vector<unique_ptr<Cursor>> cursors;
+    for (auto &run : inputs) {
+        cursors.emplace_back(new RunCursor(run, 0));
+    }
+
+    MergeIterator it(cursors);
+    RunPtr merged = writeRun(it, dropTombstones);
+    if (merged == nullptr) {
+        return false;
+    }
+
+    vector<RunPtr> runs(runs_.begin(), runs_.begin() + first);
+    runs.push_back(merged);
+    runs.insert(runs.end(), runs_.begin() + last + 1, runs_.end());
+
+    if (!saveManifest(runs)) {
+        merged->obsolete = true;
+        return false;
+    }
+
+    lock_guard<mutex> guard(mutex_);
+    for (auto &run : inputs) {
+        run->obsolete = true;
+    }
+    runs_ = runs;
+    return true;
+}
+
+template <class Key, class Value>
+void LSMTree<Key, Value>::backgroundLoop()
+{
+    unique_lock<mutex> lock(mutex_);
+
+    for (;;) {
+        size_t first = 0;
+        size_t last = 0;
+        work_.wait(lock, [this, &first, &last]() {
+            return stopping_ || (!failed_ && (immutable_ != nullptr || compactRequested_ ||
+                                              pickCompaction(first, last)));
+        });
+
+        if (failed_) {
+            return;
+        }
+
+        if (immutable_ != nullptr) {
+            Memtable *immutable = immutable_.get();
+            lock.unlock();
+
+            // immutable memtable只读，可以在锁外遍历
+            VectorCursor *cursor = new VectorCursor();
+            if (!immutable->isEmpty()) {
+                immutable->forEach(immutable->minimum(), immutable->maximum(),
+                                   [cursor](const Key &key, const Entry &entry) {
+                                       cursor->items.emplace_back(key, entry);
+                                   });
+            }
+            vector<unique_ptr<Cursor>> cursors;
+            cursors.emplace_back(cursor);
+
+            MergeIterator it(cursors);
+            RunPtr run = writeRun(it, false);
+
+            // runs_只由本线程修改，可以在锁外读取并写MANIFEST
+            vector<RunPtr> runs;
+            bool ok = run != nullptr;
+            if (ok) {
+                runs.push_back(run);
+                runs.insert(runs.end(), runs_.begin(), runs_.end());
+                ok = saveManifest(runs);
+            }
+
+            lock.lock();
+            if (ok) {
+                runs_ = runs;
+                immutable_.reset();
+            } else {
+                if (run != nullptr) {
+                    run->obsolete = true;
+                }
+                failed_ = true;
+            }
+            done_.notify_all();
+            continue;
+        }
+
+        bool full = compactRequested_;
+        if (full || pickCompaction(first, last)) {
+            if (full) {
+                first = 0;
+                last = runs_.empty() ? 0 : runs_.size() - 1;
+            }
+            bool trivial = full && runs_.size() <= 1;
+            lock.unlock();
+
+            bool ok = trivial || compactRuns(first, last);
+
+            lock.lock();
+            failed_ = failed_ || !ok;
+            if (full) {
+                compactRequested_ = false; // 期间到达的compact()请求要等到全量合并完成
+            }
+            done_.notify_all();
+            continue;
+        }
+
+        if (stopping_) {
+            return;
+        }
+    }
+}
+
+template <class Key, class Value>
+bool LSMTree<Key, Value>::syncFile(FILE *fp)
+{
+    if (fflush(fp) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(fp)) == 0;
+#else
+    return fdatasync(fileno(fp)) == 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,72 @@
+#include "LSMTree.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <sys/stat.h>
+using namespace std;
+
+/* 数据放在临时目录中，结束时删除 */
+string tempDir(const char *name)
+{
+#ifdef _WIN32
+    const char *tmp = getenv("TEMP");
+#else
+    const char *tmp = getenv("TMPDIR");
+#endif
+    return string(tmp != nullptr ? tmp : "/tmp") + "/" + name;
+}
+
+void run(const string &dir)
+{
+    LSMOptions options;
+    options.memtableEntries = 1000;
+    options.maxRuns = 4;
+
+    {
+        LSMTree<int, int> tree(options);
+        tree.open(dir);
+
+        for (int k = 0; k < 10000; k++) {
+            tree.put(k, k);
+        }
+        for (int k = 0; k < 10000; k += 2) {
+            tree.put(k, -k); // 覆盖较旧run中的值
+        }
+        tree.deleteKey(5);
+
+        tree.flush();
+        cout << "runs: " << tree.runCount() << endl;
+        tree.compact();
+        cout << "runs after compact: " << tree.runCount() << endl;
+    }
+
+    LSMTree<int, int> tree(options);
+    tree.open(dir);
+
+    int val = 0;
+    cout << "contain(5): " << tree.contain(5) << endl;
+    if (tree.get(4, val)) {
+        cout << "get(4): " << val << endl;
+    }
+
+    tree.forEach(2, 7, [](const int &key, const int &value) {
+        cout << "(" << key << ", " << value << ")" << endl;
+    });
+}
+
+int main(int argc, char **argv)
+{
+    string dir = tempDir("lsm_data");
+#ifdef _WIN32
+    mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+    LSMTree<int, int>::destroy(dir);
+
+    run(dir);
+
+    LSMTree<int, int>::destroy(dir);
+    remove(dir.c_str());
+    return 0;
+}
@@ -0,0 +1,246 @@
+#ifndef __MERKLEAVLTREE_H_
+#define __MERKLEAVLTREE_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "../AggregateAVLTree/AggregateAVLTree.h"
+#include "../tree_filter.h"
+using namespace std;
+
+/**
+ * 一段键的摘要：所有键值对的哈希之和(模2^64)与键的个数
+ * 求和与插入顺序和树的形状无关，两个副本内容相同摘要就相同；
+ * 加法可逆，区间的摘要可以由两个前缀的摘要相减得到
+ */
+struct MerkleDigest {
+    uint64_t hash;
+    int count;
+
+    bool operator==(const MerkleDigest &other) const { return hash == other.hash && count == other.count; }
+    bool operator!=(const MerkleDigest &other) const { return !(*this == other); }
+};
+
+template <class Key, class Value, class KeyHash, class ValueHash>
+struct AVLMerkleAggregate {
+    using value_type = MerkleDigest;
+
+    static value_type identity() { return MerkleDigest{0, 0}; }
+    static value_type lift(const Key &key, const Value &value) {
+        uint64_t h = hashMix64(KeyHash()(key)) * 0x9e3779b97f4a7c15ULL + hashMix64(ValueHash()(value));
+        return MerkleDigest{hashMix64(h), 1};
+    }
+    static value_type combine(const value_type &a, const value_type &b) {
+        return MerkleDigest{a.hash + b.hash, a.count + b.count};
+    }
+};
+
+/**
+ * 每个结点保存子树的MerkleDigest，put、deleteKey和旋转时由AggregateAVLTree增量维护
+ * diff比较两个副本：两边同一段键的摘要相同就跳过，否则在本地的中位键处把这一段一分为二，
+ * 键不多时再逐个比较，d处不同只需O(d log n)次摘要查询
+ * 对端只需提供下面的接口，可以是另一棵MerkleAVLTree，也可以是远程副本的代理：
+ * 1. bool isEmpty(), Key maximum()
+ * 2. MerkleDigest rangeDigest(const Key *after, const Key &hi)
+ * 3. void rangeEntries(const Key *after, const Key &hi, vector<pair<Key, uint64_t>> &out)
+ * 区间为(after, hi]，after为nullptr表示没有下界；摘要是求和而不是密码学哈希，只用于副本间的修复
+ *
+ * 不变式：每个结点的摘要与子树中的键值对一致。值在树外被原地修改时摘要不会更新，
+ * diff会漏掉这些键，因此私有继承，只开放经过摘要维护的修改(put、compute、upsert、删除)，
+ * 读取只给出const的值；get/put返回的可写指针、multiGet、kNearest、floorMany等不开放
+ */
+template <class Key, class Value, class KeyHash = hash<Key>, class ValueHash = hash<Value>>
+class MerkleAVLTree : private AggregateAVLTree<Key, Value, AVLMerkleAggregate<Key, Value, KeyHash, ValueHash>> {
+public:
+    using Monoid = AVLMerkleAggregate<Key, Value, KeyHash, ValueHash>;
+    using MyAggregateTree = AggregateAVLTree<Key, Value, Monoid>;
+    using MyAVLTreeNode = typename MyAggregateTree::MyAVLTreeNode;
+
+public:
+    using MyAggregateTree::size;
+    using MyAggregateTree::isEmpty;
+    using MyAggregateTree::contain;
+    using MyAggregateTree::minimum;
+    using MyAggregateTree::maximum;
+    using MyAggregateTree::floor;
+    using MyAggregateTree::ceiling;
+    using MyAggregateTree::get;
+    using MyAggregateTree::put;
+    using MyAggregateTree::compute;
+    using MyAggregateTree::upsert;
+    using MyAggregateTree::deleteKey;
+    using MyAggregateTree::deleteMin;
+    using MyAggregateTree::deleteMax;
+    using MyAggregateTree::popMin;
+    using MyAggregateTree::popMax;
+    using MyAggregateTree::deleteRange;
+    using MyAggregateTree::clear;
+    using MyAggregateTree::forEach;
+    using MyAggregateTree::memoryUsage;
+    using MyAggregateTree::shrink;
+
+
+    /* 整棵树的摘要 */
+    MerkleDigest digest() { return digestOf(this->root_); }
+
+    /* (after, hi]之间的键值对的摘要 */
+    MerkleDigest rangeDigest(const Key *after, const Key &hi);
+
+    /* 按升序输出(after, hi]之间的键和键值对的哈希 */
+    void rangeEntries(const Key *after, const Key &hi, vector<pair<Key, uint64_t>> &out);
+
+    /* 与对端内容不同的键(一边缺少或值不同)，按升序追加到out */
+    template <class Remote>
+    void diff(Remote &remote, vector<Key> &out);
+
+private:
+    static const int kLeafEntries = 16;  // 两边的键数之和不超过它时逐个比较
+
+    static MerkleDigest digestOf(const MyAVLTreeNode *x) { return x != nullptr ? x->agg : Monoid::identity(); }
+
+    /* 所有<=key的键值对的摘要 */
+    MerkleDigest prefixDigest(const Key &key);
+
+    /* 升序排在第rank位(从0开始)的结点 */
+    const MyAVLTreeNode *select(int rank);
+
+    template <class Remote>
+    void diffRange(Remote &remote, const Key *after, const Key &hi, vector<Key> &out);
+};
+
+template <class Key, class Value, class KeyHash, class ValueHash>
+MerkleDigest MerkleAVLTree<Key, Value, KeyHash, ValueHash>::prefixDigest(const Key &key)
+{
+    MerkleDigest result = Monoid::identity();
+
+    const MyAVLTreeNode *x = this->root_;
+    while (x != nullptr) {
+        if (key < x->key) {
+            x = x->left;
+        } else {
+            // 子树x的摘要减去右子树的摘要，就是左子树加上x本身
+            MerkleDigest self = digestOf(x);
+            MerkleDigest right = digestOf(x->right);
+            result = Monoid::combine(result, MerkleDigest{self.hash - right.hash, self.count - right.count});
+            x = x->right;
+        }
+    }
+
+    return result;
+}
+
+template <class Key, class Value, class KeyHash, class ValueHash>
+MerkleDigest MerkleAVLTree<Key, Value, KeyHash, ValueHash>::rangeDigest(const Key *after, const Key &hi)
+{
+    MerkleDigest upper = prefixDigest(hi);
+    if (after == nullptr) {
+        return upper;
+    }
+
+    MerkleDigest lower = prefixDigest(*after);
+    return MerkleDigest{upper.hash - lower.hash, upper.count - lower.count};
+}
+
+template <class Key, class Value, class KeyHash, class ValueHash>
+void MerkleAVLTree<Key, Value, KeyHash, ValueHash>::rangeEntries(const Key *after, const Key &hi,
+                                                                  vector<pair<Key, uint64_t>> &out)
+{
+    if (this->isEmpty()) {
+        return;
+    }
+
+    const Key lo = after != nullptr ? *after : this->minimum();
+    this->forEach(lo, hi, [after, &out](const Key &key, const Value &value) {
+        if (after == nullptr || *after < key) {
+            out.emplace_back(key, Monoid::lift(key, value).hash);
+        }
+    });
+}
+
+template <class Key, class Value, class KeyHash, class ValueHash>
+const typename MerkleAVLTree<Key, Value, KeyHash, ValueHash>::MyAVLTreeNode *
+MerkleAVLTree<Key, Value, KeyHash, ValueHash>::select(int rank)
+{
+    const MyAVLTreeNode *x = this->root_;
+    while (x != nullptr) {
+        int leftCount = digestOf(x->left).count;
+        if (rank < leftCount) {
+            x = x->left;
+        } else if (rank == leftCount) {
+            return x;
+        } else {
+            rank -= leftCount + 1;
+            x = x->right;
+        }
+    }
+    return nullptr;
+}
+
+template <class Key, class Value, class KeyHash, class ValueHash>
+template <class Remote>
+void MerkleAVLTree<Key, Value, KeyHash, ValueHash>::diff(Remote &remote, vector<Key> &out)
+{
+    if (this->isEmpty() && remote.isEmpty()) {
+        return;
+    }
+
+    Key hi;
+    if (this->isEmpty()) {
+        hi = remote.maximum();
+    } else if (remote.isEmpty()) {
+        hi = this->maximum();
+    } else {
+        hi = this->maximum() < remote.maximum() ? remote.maximum() : this->maximum();
+    }
+
+    diffRange(remote, nullptr, hi, out);
+}
+
+/**
+ * @brief 比较(after, hi]：摘要相同时跳过；一边为空或键很少时逐个比较；
+ * 否则按本地在这一段中的中位键m分成(after, m]和(m, hi]
+ */
+template <class Key, class Value, class KeyHash, class ValueHash>
+template <class Remote>
+void MerkleAVLTree<Key, Value, KeyHash, ValueHash>::diffRange(Remote &remote, const Key *after, const Key &hi,
+                                                              vector<Key> &out)
+{
+    MerkleDigest upper = prefixDigest(hi);
+    MerkleDigest lower = after != nullptr ? prefixDigest(*after) : Monoid::identity();
+    MerkleDigest local = {upper.hash - lower.hash, upper.count - lower.count};
+    MerkleDigest other = remote.rangeDigest(after, hi);
+    if (local == other) {
+        return;
+    }
+
+    if (local.count <= 1 || other.count == 0 || local.count + other.count <= kLeafEntries) {
+        vector<pair<Key, uint64_t>> mine;
+        vector<pair<Key, uint64_t>> theirs;
+        rangeEntries(after, hi, mine);
+        remote.rangeEntries(after, hi, theirs);
+
+        // 两个有序序列归并，只出现在一边或哈希不同的键是差异
+        size_t i = 0;
+        size_t j = 0;
+        while (i < mine.size() || j < theirs.size()) {
+            if (j == theirs.size() || (i < mine.size() && mine[i].first < theirs[j].first)) {
+                out.push_back(mine[i++].first);
+            } else if (i == mine.size() || theirs[j].first < mine[i].first) {
+                out.push_back(theirs[j++].first);
+            } else {
+                if (mine[i].second != theirs[j].second) {
+                    out.push_back(mine[i].first);
+                }
+                i++;
+                j++;
+            }
+        }
+        return;
+    }
+
+    const Key mid = select(lower.count + (local.count - 1) / 2)->key;
+    diffRange(remote, after, mid, out);
+    diffRange(remote, &mid, hi, out);
+}
+
+#endif
@@ -0,0 +1,32 @@
+#include "MerkleAVLTree.h"
+
+#include <iostream>
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    MerkleAVLTree<int, int> primary;
+    MerkleAVLTree<int, int> replica;
+
+    // 插入顺序不同，树的形状不同，摘要相同
+    for (int i = 0; i < 1000; i++) {
+        primary.put(i, i * 2);
+        replica.put(999 - i, (999 - i) * 2);
+    }
+    cout << "same digest: " << (primary.digest() == replica.digest()) << endl;
+
+    replica.put(17, -1);
+    replica.deleteKey(500);
+    replica.put(1500, 3000);
+    replica.upsert(42, [](int &value) { value++; });
+
+    vector<int> keys;
+    primary.diff(replica, keys);
+    cout << "diff:";
+    for (int key : keys) {
+        cout << " " << key;
+    }
+    cout << endl;
+
+    return 0;
+}
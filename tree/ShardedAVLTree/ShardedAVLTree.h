@@ -0,0 +1,342 @@
+#ifndef __SHARDEDAVLTREE_H_
+#define __SHARDEDAVLTREE_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <algorithm>
+#include "../AVLTree/AVLTree.h"
+using namespace std;
+
+/**
+ * 按键的范围把表切分到N个互相独立的AVLTree(分片)上，每个分片由自己的读写锁保护
+ * 1. 分片i保存[bounds[i-1], bounds[i])之间的键，分片之间天然有序
+ * 2. 点操作只锁一个分片；范围扫描按升序对涉及的分片加读锁，再依次扫描
+ * 3. 分片边界保存在不可变的Layout中，用shared_ptr原子地发布，读者定位期间持有引用，
+ *    最后一个读者放手时旧Layout自动释放；调整边界时必须同时持有相邻两个分片的写锁，
+ *    因此持有分片锁后只要当前Layout未变，键到分片的映射就是有效的
+ * 4. AVLTree本身仍然是单线程的实现，并发控制全部在这一层完成
+ */
+template <class Key, class Value>
+class ShardedAVLTree {
+public:
+    using MyAVLTree = AVLTree<Key, Value>;
+
+    /* splitKeys为升序的分割键，共splitKeys.size() + 1个分片 */
+    explicit ShardedAVLTree(const vector<Key> &splitKeys);
+    ~ShardedAVLTree() = default;
+
+    ShardedAVLTree(const ShardedAVLTree &) = delete;
+    ShardedAVLTree &operator=(const ShardedAVLTree &) = delete;
+
+public:
+    int size();
+    bool isEmpty() { return size() == 0; }
+    int shardCount() { return static_cast<int>(shards_.size()); }
+    int shardSize(int i);
+
+    bool contain(const Key &key);
+    bool get(const Key &key, Value &val);
+    void put(const Key &key, const Value &val);
+    void deleteKey(const Key &key);
+
+    /* 按键的升序访问[lo, hi]之间的所有键值对，扫描期间涉及的分片保持读锁 */
+    template <class Func>
+    void forEach(const Key &lo, const Key &hi, Func fn);
+
+    /* 在线调整分片边界，使各分片的键数量接近平均值；同一时刻最多阻塞相邻两个分片 */
+    void rebalance();
+
+private:
+    struct Shard {
+        shared_timed_mutex lock;
+        MyAVLTree tree;
+    };
+
+    struct Layout {
+        vector<Key> bounds; // bounds[i]是分片i+1中允许的最小键
+    };
+
+    int shardIndex(const Layout *layout, const Key &key);
+
+    /* 读者持有返回的引用期间，Layout不会被释放，地址也不会被新的Layout复用 */
+    shared_ptr<const Layout> loadLayout() { return atomic_load(&layout_); }
+    bool isCurrent(const shared_ptr<const Layout> &layout) { return current_.load(memory_order_acquire) == layout.get(); }
+
+    int lockShared(const Key &key);
+    int lockExclusive(const Key &key);
+
+    void moveToRight(int i, int n);
+    void moveToLeft(int i, int n);
+    void publishBound(int i, const Key &bound);
+
+private:
+    vector<unique_ptr<Shard>> shards_;
+    shared_ptr<const Layout> layout_;   // 只通过atomic_load/atomic_store访问
+    atomic<const Layout *> current_;    // layout_.get()，持有分片锁后用来廉价地校验
+
+    mutex rebalanceLock_;
+};
+
+template <class Key, class Value>
+ShardedAVLTree<Key, Value>::ShardedAVLTree(const vector<Key> &splitKeys)
+{
+    assert(is_sorted(splitKeys.begin(), splitKeys.end()));
+
+    for (size_t i = 0; i <= splitKeys.size(); i++) {
+        shards_.emplace_back(new Shard());
+    }
+
+    shared_ptr<const Layout> layout = make_shared<Layout>(Layout{splitKeys});
+    current_.store(layout.get(), memory_order_relaxed);
+    atomic_store(&layout_, layout);
+}
+
+template <class Key, class Value>
+int ShardedAVLTree<Key, Value>::shardIndex(const Layout *layout, const Key &key)
+{
+    const vector<Key> &bounds = layout->bounds;
+    return static_cast<int>(upper_bound(bounds.begin(), bounds.end(), key) - bounds.begin());
+}
+
+/**
+ * @brief 对key所在的分片加读锁，返回分片下标
+ * 加锁之后Layout若已被替换，说明边界可能移动过，需要重新定位
+ */
+template <class Key, class Value>
+int ShardedAVLTree<Key, Value>::lockShared(const Key &key)
+{
+    for (;;) {
+        shared_ptr<const Layout> layout = loadLayout();
+        int i = shardIndex(layout.get(), key);
+
+        shards_[i]->lock.lock_shared();
+        if (isCurrent(layout)) {
+            return i;
+        }
+        shards_[i]->lock.unlock_shared();
+    }
+}
+
+template <class Key, class Value>
+int ShardedAVLTree<Key, Value>::lockExclusive(const Key &key)
+{
+    for (;;) {
+        shared_ptr<const Layout> layout = loadLayout();
+        int i = shardIndex(layout.get(), key);
+
+        shards_[i]->lock.lock();
+        if (isCurrent(layout)) {
+            return i;
+        }
+        shards_[i]->lock.unlock();
+    }
+}
+
+template <class Key, class Value>
+int ShardedAVLTree<Key, Value>::size()
+{
+    int total = 0;
+    for (size_t i = 0; i < shards_.size(); i++) {
+        total += shardSize(static_cast<int>(i));
+    }
+    return total;
+}
+
+template <class Key, class Value>
+int ShardedAVLTree<Key, Value>::shardSize(int i)
+{
+    shared_lock<shared_timed_mutex> guard(shards_[i]->lock);
+    return shards_[i]->tree.size();
+}
+
+template <class Key, class Value>
+bool ShardedAVLTree<Key, Value>::contain(const Key &key)
+{
+    int i = lockShared(key);
+    shared_lock<shared_timed_mutex> guard(shards_[i]->lock, adopt_lock);
+
+    return shards_[i]->tree.contain(key);
+}
+
+template <class Key, class Value>
+bool ShardedAVLTree<Key, Value>::get(const Key &key, Value &val)
+{
+    int i = lockShared(key);
+    shared_lock<shared_timed_mutex> guard(shards_[i]->lock, adopt_lock);
+
+    Value *found = shards_[i]->tree.get(key);
+    if (found == nullptr) {
+        return false;
+    }
+
+    val = *found;
+    return true;
+}
+
+template <class Key, class Value>
+void ShardedAVLTree<Key, Value>::put(const Key &key, const Value &val)
+{
+    int i = lockExclusive(key);
+    unique_lock<shared_timed_mutex> guard(shards_[i]->lock, adopt_lock);
+
+    shards_[i]->tree.put(key, val);
+}
+
+template <class Key, class Value>
+void ShardedAVLTree<Key, Value>::deleteKey(const Key &key)
+{
+    int i = lockExclusive(key);
+    unique_lock<shared_timed_mutex> guard(shards_[i]->lock, adopt_lock);
+
+    shards_[i]->tree.deleteKey(key);
+}
+
+/**
+ * 分片按范围划分，依次扫描[lo, hi]涉及的分片即得到有序的结果；
+ * 按下标升序加锁，与rebalance的加锁顺序一致，不会死锁
+ */
+template <class Key, class Value>
+template <class Func>
+void ShardedAVLTree<Key, Value>::forEach(const Key &lo, const Key &hi, Func fn)
+{
+    if (hi < lo) {
+        return;
+    }
+
+    for (;;) {
+        shared_ptr<const Layout> layout = loadLayout();
+        int first = shardIndex(layout.get(), lo);
+        int last = shardIndex(layout.get(), hi);
+
+        for (int i = first; i <= last; i++) {
+            shards_[i]->lock.lock_shared();
+        }
+
+        bool valid = isCurrent(layout);
+        if (valid) {
+            for (int i = first; i <= last; i++) {
+                shards_[i]->tree.forEach(lo, hi, fn);
+            }
+        }
+
+        for (int i = first; i <= last; i++) {
+            shards_[i]->lock.unlock_shared();
+        }
+
+        if (valid) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief 发布新的分割键bounds[i]，调用方持有分片i和i+1的写锁
+ * 旧Layout由仍在定位的读者的引用保持，最后一个引用消失时释放，不会随rebalance的次数增长
+ */
+template <class Key, class Value>
+void ShardedAVLTree<Key, Value>::publishBound(int i, const Key &bound)
+{
+    shared_ptr<Layout> layout = make_shared<Layout>(*loadLayout());
+    layout->bounds[i] = bound;
+
+    current_.store(layout.get(), memory_order_release);
+    atomic_store(&layout_, shared_ptr<const Layout>(move(layout)));
+}
+
+/**
+ * @brief 把分片i中最大的n个键移动到分片i+1
+ */
+template <class Key, class Value>
+void ShardedAVLTree<Key, Value>::moveToRight(int i, int n)
+{
+    unique_lock<shared_timed_mutex> leftGuard(shards_[i]->lock);
+    unique_lock<shared_timed_mutex> rightGuard(shards_[i + 1]->lock);
+
+    MyAVLTree &from = shards_[i]->tree;
+    MyAVLTree &to = shards_[i + 1]->tree;
+
+    n = min(n, from.size());
+    if (n <= 0) {
+        return;
+    }
+
+    for (int k = 0; k < n; k++) {
+        pair<Key, Value> item = from.popMax();
+        to.put(item.first, item.second);
+    }
+
+    publishBound(i, to.minimum());
+}
+
+/**
+ * @brief 把分片i+1中最小的n个键移动到分片i，分片i+1至少保留一个键用作新的边界
+ */
+template <class Key, class Value>
+void ShardedAVLTree<Key, Value>::moveToLeft(int i, int n)
+{
+    unique_lock<shared_timed_mutex> leftGuard(shards_[i]->lock);
+    unique_lock<shared_timed_mutex> rightGuard(shards_[i + 1]->lock);
+
+    MyAVLTree &from = shards_[i + 1]->tree;
+    MyAVLTree &to = shards_[i]->tree;
+
+    n = min(n, from.size() - 1);
+    if (n <= 0) {
+        return;
+    }
+
+    for (int k = 0; k < n; k++) {
+        pair<Key, Value> item = from.popMin();
+        to.put(item.first, item.second);
+    }
+
+    publishBound(i, from.minimum());
+}
+
+/**
+ * 把第i个边界看作前缀计数prefix[i] = size(0) + ... + size(i)，目标为total * (i + 1) / N
+ * 1. 从右向左处理需要右移的边界，右侧的边界先让出空间
+ * 2. 从左向右处理需要左移的边界，左侧的边界先让出空间
+ * 每一步只锁相邻的两个分片，其它分片上的读写不受影响
+ */
+template <class Key, class Value>
+void ShardedAVLTree<Key, Value>::rebalance()
+{
+    lock_guard<mutex> guard(rebalanceLock_);
+
+    int n = shardCount();
+    if (n < 2) {
+        return;
+    }
+
+    long long total = size();
+
+    for (int i = n - 2; i >= 0; i--) {
+        long long prefix = 0;
+        for (int j = 0; j <= i; j++) {
+            prefix += shardSize(j);
+        }
+
+        long long target = total * (i + 1) / n;
+        if (prefix < target) {
+            moveToLeft(i, static_cast<int>(target - prefix));
+        }
+    }
+
+    for (int i = 0; i < n - 1; i++) {
+        long long prefix = 0;
+        for (int j = 0; j <= i; j++) {
+            prefix += shardSize(j);
+        }
+
+        long long target = total * (i + 1) / n;
+        if (prefix > target) {
+            moveToRight(i, static_cast<int>(prefix - target));
+        }
+    }
+}
+
+#endif
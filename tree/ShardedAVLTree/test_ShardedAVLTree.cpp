@@ -0,0 +1,52 @@
+#include "ShardedAVLTree.h"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+void printShards(ShardedAVLTree<int, int> &tree)
+{
+    for (int i = 0; i < tree.shardCount(); i++) {
+        cout << "shard " << i << ": " << tree.shardSize(i) << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ShardedAVLTree<int, int> tree({1000, 2000, 3000});
+
+    // 所有的键都落在前两个分片上
+    vector<thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([&tree, t]() {
+            for (int k = t; k < 1600; k += 4) {
+                tree.put(k, k * 10);
+            }
+        });
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    cout << "size: " << tree.size() << endl;
+    printShards(tree);
+
+    tree.rebalance();
+    cout << "after rebalance" << endl;
+    printShards(tree);
+
+    int val = 0;
+    if (tree.get(1234, val)) {
+        cout << "get(1234): " << val << endl;
+    }
+
+    tree.deleteKey(1234);
+    cout << "contain(1234): " << tree.contain(1234) << endl;
+
+    tree.forEach(396, 404, [](const int &key, const int &value) {
+        cout << "(" << key << ", " << value << ")" << endl;
+    });
+
+    return 0;
+}
@@ -0,0 +1,275 @@
+#ifndef __STATICAVLTREE_H_
+#define __STATICAVLTREE_H_
+
+#include <cassert>
+#include "../AVLTree/AVLBalancer.h"
+
+/**
+ * 固定容量、不使用堆的AVL树，用于大量的小表
+ * 1. N个结点保存在对象内部的数组中，左右子结点用数组下标表示，-1表示空
+ * 2. 删除的结点通过left串成空闲链表，优先复用；从未使用过的结点按下标顺序分配
+ * 3. 旋转和平衡与AVLTree共用AVLBalancer
+ * 4. 所有操作都是constexpr，键和值是字面量类型时可以在编译期建树和查找
+ * 表满时put新键返回false，不修改树
+ */
+template <class Key, class Value, int N>
+class StaticAVLTree : private AVLBalancer<StaticAVLTree<Key, Value, N>, int> {
+public:
+    static_assert(N > 0, "StaticAVLTree requires a positive capacity");
+
+    constexpr StaticAVLTree();
+
+public:
+    constexpr int size() const { return count_; }
+    constexpr int capacity() const { return N; }
+    constexpr bool isEmpty() const { return count_ == 0; }
+    constexpr bool isFull() const { return count_ == N; }
+    constexpr bool contain(const Key &key) { return get(key) != nullptr; }
+
+    constexpr Value *get(const Key &key);
+
+    /* 表满且key不存在时返回false */
+    constexpr bool put(const Key &key, const Value &val);
+
+    constexpr void deleteKey(const Key &key) { root_ = deleteKey(root_, key); }
+
+    constexpr Key minimum();
+    constexpr Key maximum();
+
+    constexpr void deleteMin() { if (root_ != kNull) deleteKey(minimum()); }
+    constexpr void deleteMax() { if (root_ != kNull) deleteKey(maximum()); }
+
+    constexpr void clear();
+
+    /* 按键的升序访问[lo, hi]之间的所有键值对，fn(key, value) */
+    template <class Func>
+    constexpr void forEach(const Key &lo, const Key &hi, Func fn) { forEach(root_, lo, hi, fn); }
+
+private:
+    using Balancer = AVLBalancer<StaticAVLTree<Key, Value, N>, int>;
+    friend Balancer;
+    using Balancer::rebalance;
+
+    static constexpr int kNull = -1;
+
+    struct Slot {
+        Key key;
+        Value value;
+        int left;
+        int right;
+        int height;
+    };
+
+    /* 供AVLBalancer访问结点 */
+    constexpr int &leftOf(int x) { return slots_[x].left; }
+    constexpr int &rightOf(int x) { return slots_[x].right; }
+    constexpr bool isNull(int x) { return x == kNull; }
+    constexpr int getNodeHeight(int x) { return x == kNull ? 0 : slots_[x].height; }
+    constexpr void updateNode(int x);
+
+    constexpr int allocSlot(const Key &key, const Value &val);
+    constexpr void freeSlot(int x);
+
+    constexpr int put(int x, const Key &key, const Value &val, bool &ok);
+    constexpr int deleteKey(int x, const Key &key);
+    constexpr int detachMin(int x, int &minSlot);
+
+    template <class Func>
+    constexpr void forEach(int x, const Key &lo, const Key &hi, Func &fn);
+
+private:
+    Slot slots_[N];
+    int root_;
+    int free_;  // 空闲链表
+    int used_;  // 从未使用过的第一个下标
+    int count_;
+};
+
+template <class Key, class Value, int N>
+constexpr StaticAVLTree<Key, Value, N>::StaticAVLTree()
+    : slots_(), root_(kNull), free_(kNull), used_(0), count_(0)
+{
+}
+
+template <class Key, class Value, int N>
+constexpr void StaticAVLTree<Key, Value, N>::updateNode(int x)
+{
+    int l = getNodeHeight(slots_[x].left);
+    int r = getNodeHeight(slots_[x].right);
+    slots_[x].height = (l > r ? l : r) + 1;
+}
+
+template <class Key, class Value, int N>
+constexpr int StaticAVLTree<Key, Value, N>::allocSlot(const Key &key, const Value &val)
+{
+    int x = kNull;
+    if (free_ != kNull) {
+        x = free_;
+        free_ = slots_[x].left;
+    } else if (used_ < N) {
+        x = used_++;
+    } else {
+        return kNull;
+    }
+
+    slots_[x].key = key;
+    slots_[x].value = val;
+    slots_[x].left = kNull;
+    slots_[x].right = kNull;
+    slots_[x].height = 1;
+    count_++;
+    return x;
+}
+
+template <class Key, class Value, int N>
+constexpr void StaticAVLTree<Key, Value, N>::freeSlot(int x)
+{
+    slots_[x].left = free_;
+    free_ = x;
+    count_--;
+}
+
+template <class Key, class Value, int N>
+constexpr void StaticAVLTree<Key, Value, N>::clear()
+{
+    root_ = kNull;
+    free_ = kNull;
+    used_ = 0;
+    count_ = 0;
+}
+
+template <class Key, class Value, int N>
+constexpr Value *StaticAVLTree<Key, Value, N>::get(const Key &key)
+{
+    int x = root_;
+    while (x != kNull) {
+        if (slots_[x].key == key) {
+            return &slots_[x].value;
+        }
+        x = key < slots_[x].key ? slots_[x].left : slots_[x].right;
+    }
+    return nullptr;
+}
+
+template <class Key, class Value, int N>
+constexpr bool StaticAVLTree<Key, Value, N>::put(const Key &key, const Value &val)
+{
+    bool ok = true;
+    root_ = put(root_, key, val, ok);
+    return ok;
+}
+
+/**
+ * @brief 与AVLTree::put相同，没有空闲结点时ok置为false，树的结构不变
+ */
+template <class Key, class Value, int N>
+constexpr int StaticAVLTree<Key, Value, N>::put(int x, const Key &key, const Value &val, bool &ok)
+{
+    if (x == kNull) {
+        int node = allocSlot(key, val);
+        ok = node != kNull;
+        return node;
+    }
+
+    if (key < slots_[x].key) {
+        slots_[x].left = put(slots_[x].left, key, val, ok);
+    } else if (slots_[x].key < key) {
+        slots_[x].right = put(slots_[x].right, key, val, ok);
+    } else {
+        slots_[x].value = val;
+        return x;
+    }
+
+    return rebalance(x);
+}
+
+template <class Key, class Value, int N>
+constexpr int StaticAVLTree<Key, Value, N>::detachMin(int x, int &minSlot)
+{
+    if (slots_[x].left == kNull) {
+        minSlot = x;
+        return slots_[x].right;
+    }
+
+    slots_[x].left = detachMin(slots_[x].left, minSlot);
+    return rebalance(x);
+}
+
+/**
+ * @brief 有两个子结点时把右子树的最小结点摘下来接到被删除结点的位置
+ */
+template <class Key, class Value, int N>
+constexpr int StaticAVLTree<Key, Value, N>::deleteKey(int x, const Key &key)
+{
+    if (x == kNull) {
+        return x;
+    }
+
+    if (key < slots_[x].key) {
+        slots_[x].left = deleteKey(slots_[x].left, key);
+        return rebalance(x);
+    }
+    if (slots_[x].key < key) {
+        slots_[x].right = deleteKey(slots_[x].right, key);
+        return rebalance(x);
+    }
+
+    int newX = kNull;
+    if (slots_[x].left == kNull || slots_[x].right == kNull) {
+        newX = slots_[x].left != kNull ? slots_[x].left : slots_[x].right;
+    } else {
+        int successor = kNull;
+        int right = detachMin(slots_[x].right, successor);
+        slots_[successor].right = right;
+        slots_[successor].left = slots_[x].left;
+        newX = rebalance(successor);
+    }
+
+    freeSlot(x);
+    return newX;
+}
+
+template <class Key, class Value, int N>
+constexpr Key StaticAVLTree<Key, Value, N>::minimum()
+{
+    assert(count_ != 0);
+
+    int x = root_;
+    while (slots_[x].left != kNull) {
+        x = slots_[x].left;
+    }
+    return slots_[x].key;
+}
+
+template <class Key, class Value, int N>
+constexpr Key StaticAVLTree<Key, Value, N>::maximum()
+{
+    assert(count_ != 0);
+
+    int x = root_;
+    while (slots_[x].right != kNull) {
+        x = slots_[x].right;
+    }
+    return slots_[x].key;
+}
+
+template <class Key, class Value, int N>
+template <class Func>
+constexpr void StaticAVLTree<Key, Value, N>::forEach(int x, const Key &lo, const Key &hi, Func &fn)
+{
+    if (x == kNull) {
+        return;
+    }
+
+    if (lo < slots_[x].key) {
+        forEach(slots_[x].left, lo, hi, fn);
+    }
+    if (!(slots_[x].key < lo) && !(hi < slots_[x].key)) {
+        fn(slots_[x].key, slots_[x].value);
+    }
+    if (slots_[x].key < hi) {
+        forEach(slots_[x].right, lo, hi, fn);
+    }
+}
+
+#endif
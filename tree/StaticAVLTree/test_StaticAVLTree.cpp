@@ -0,0 +1,43 @@
+#include "StaticAVLTree.h"
+
+#include <iostream>
+using namespace std;
+
+/* 编译期建一棵平方表并查找 */
+constexpr int squareOf(int n)
+{
+    StaticAVLTree<int, int, 16> table;
+    for (int i = 0; i < 16; i++) {
+        table.put(i, i * i);
+    }
+    table.deleteKey(3);
+    return table.contain(3) ? -1 : *table.get(n);
+}
+
+static_assert(squareOf(7) == 49, "compile-time lookup");
+
+int main(int argc, char **argv)
+{
+    StaticAVLTree<int, int, 4> small;
+
+    small.put(5, 50);
+    small.put(1, 10);
+    small.put(3, 30);
+    small.put(7, 70);
+    cout << "size: " << small.size() << ", full: " << small.isFull() << endl;
+    cout << "put(9) when full: " << small.put(9, 90) << endl;
+
+    small.deleteKey(1);
+    cout << "put(9) after delete: " << small.put(9, 90) << endl;
+
+    small.forEach(0, 100, [](const int &key, const int &val) {
+        cout << "(" << key << ", " << val << ") ";
+    });
+    cout << endl;
+
+    cout << "MIN: " << small.minimum() << endl;
+    cout << "MAX: " << small.maximum() << endl;
+    cout << "squareOf(7): " << squareOf(7) << endl;
+
+    return 0;
+}
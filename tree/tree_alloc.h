@@ -0,0 +1,385 @@
+#ifndef __TREE_ALLOC_H_
+#define __TREE_ALLOC_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+/**
+ * 按块分配结点的内存池
+ * 1. 块的大小从16个结点开始翻倍，最大4096个结点，小树不会浪费太多内存
+ * 2. 先从最新的块中顺序分配，释放的结点挂在空闲链表上优先复用
+ * 3. releaseAll直接释放所有块，不调用结点的析构函数，
+ *    只用于析构函数平凡的结点，清空整棵树的代价与块数成正比
+ * 4. 单个结点释放后不会归还块，大量删除之后由树把结点搬到新的池中(见AVLTree::shrink)，再释放旧池
+ */
+template <class Node>
+class NodePool {
+public:
+    NodePool() : freeList_(nullptr), bump_(nullptr), bumpEnd_(nullptr), nextSize_(kMinBlock), capacity_(0) {}
+    ~NodePool() { releaseAll(); }
+
+    NodePool(const NodePool &) = delete;
+    NodePool &operator=(const NodePool &) = delete;
+
+public:
+    void *allocate();
+    void deallocate(void *p);
+
+    /* 释放所有块 */
+    void releaseAll();
+
+    /* 交出所有块的所有权，由freeBlocks在其它线程释放 */
+    vector<void *> takeBlocks();
+    static void freeBlocks(const vector<void *> &blocks);
+
+    /* 交换两个池中的全部内容 */
+    void swap(NodePool &other);
+
+    /* 所有块中结点的个数，包括空闲的 */
+    size_t capacity() const { return capacity_; }
+
+    /* 所有块占用的字节数 */
+    size_t memoryUsage() const { return capacity_ * sizeof(Slot) + blocks_.capacity() * sizeof(void *); }
+
+private:
+    static const size_t kMinBlock = 16;
+    static const size_t kMaxBlock = 4096;
+
+    union Slot {
+        Slot *next;
+        alignas(Node) unsigned char storage[sizeof(Node)];
+    };
+
+    void reset();
+
+private:
+    vector<void *> blocks_;
+    Slot *freeList_;
+    Slot *bump_;
+    Slot *bumpEnd_;
+    size_t nextSize_;
+    size_t capacity_;  // 所有块中结点的个数
+};
+
+template <class Node>
+void *NodePool<Node>::allocate()
+{
+    if (freeList_ != nullptr) {
+        Slot *slot = freeList_;
+        freeList_ = slot->next;
+        return slot;
+    }
+
+    if (bump_ == bumpEnd_) {
+        Slot *block = static_cast<Slot *>(::operator new(nextSize_ * sizeof(Slot)));
+        blocks_.push_back(block);
+        bump_ = block;
+        bumpEnd_ = block + nextSize_;
+        capacity_ += nextSize_;
+        nextSize_ = nextSize_ * 2 < kMaxBlock ? nextSize_ * 2 : kMaxBlock;
+    }
+
+    return bump_++;
+}
+
+template <class Node>
+void NodePool<Node>::deallocate(void *p)
+{
+    Slot *slot = static_cast<Slot *>(p);
+    slot->next = freeList_;
+    freeList_ = slot;
+}
+
+template <class Node>
+void NodePool<Node>::reset()
+{
+    blocks_.clear();
+    freeList_ = nullptr;
+    bump_ = nullptr;
+    bumpEnd_ = nullptr;
+    nextSize_ = kMinBlock;
+    capacity_ = 0;
+}
+
+template <class Node>
+void NodePool<Node>::releaseAll()
+{
+    freeBlocks(blocks_);
+    reset();
+    blocks_.shrink_to_fit();
+}
+
+template <class Node>
+vector<void *> NodePool<Node>::takeBlocks()
+{
+    vector<void *> blocks;
+    blocks.swap(blocks_);
+    reset();
+    return blocks;
+}
+
+template <class Node>
+void NodePool<Node>::freeBlocks(const vector<void *> &blocks)
+{
+    for (void *block : blocks) {
+        ::operator delete(block);
+    }
+}
+
+template <class Node>
+void NodePool<Node>::swap(NodePool &other)
+{
+    blocks_.swap(other.blocks_);
+    std::swap(freeList_, other.freeList_);
+    std::swap(bump_, other.bump_);
+    std::swap(bumpEnd_, other.bumpEnd_);
+    std::swap(nextSize_, other.nextSize_);
+    std::swap(capacity_, other.capacity_);
+}
+
+/**
+ * 保存在结点外的值的分块区域
+ * 1. 块的大小从4个值开始翻倍，最大256个值，块不会移动，结点直接引用其中的值
+ * 2. 释放的槽挂在空闲链表上优先复用
+ * 3. clear析构仍在使用的值并释放所有块，值的析构函数平凡时不需要逐个访问
+ * 4. 与NodePool一样，大量删除之后由树把值复制到新的区域中，再整体释放旧区域
+ */
+template <class Value>
+class ValueArena {
+public:
+    ValueArena() : freeList_(nullptr), bump_(nullptr), bumpEnd_(nullptr), nextSize_(kMinChunk), capacity_(0) {}
+    ~ValueArena() { clear(); }
+
+    ValueArena(const ValueArena &) = delete;
+    ValueArena &operator=(const ValueArena &) = delete;
+
+public:
+    Value *allocate(const Value &val);
+    void deallocate(Value *p);
+
+    /* 析构所有值，释放所有块 */
+    void clear();
+
+    /* 交换两个区域中的全部内容，用于把整个区域交给其它线程释放 */
+    void swap(ValueArena &other);
+
+    /* 所有块中槽的个数，包括空闲的 */
+    size_t capacity() const { return capacity_; }
+
+    /* 所有块占用的字节数 */
+    size_t memoryUsage() const { return capacity_ * sizeof(Slot) + chunks_.capacity() * sizeof(Chunk); }
+
+private:
+    static const size_t kMinChunk = 4;
+    static const size_t kMaxChunk = 256;
+
+    struct Slot {
+        union {
+            Slot *next;
+            alignas(Value) unsigned char storage[sizeof(Value)];
+        };
+        bool live;
+    };
+
+    struct Chunk {
+        Slot *slots;
+        size_t size;
+    };
+
+private:
+    vector<Chunk> chunks_;
+    Slot *freeList_;
+    Slot *bump_;
+    Slot *bumpEnd_;
+    size_t nextSize_;
+    size_t capacity_;  // 所有块中槽的个数
+};
+
+template <class Value>
+Value *ValueArena<Value>::allocate(const Value &val)
+{
+    Slot *slot = freeList_;
+    if (slot != nullptr) {
+        freeList_ = slot->next;
+    } else {
+        if (bump_ == bumpEnd_) {
+            Slot *slots = static_cast<Slot *>(::operator new(nextSize_ * sizeof(Slot)));
+            for (size_t i = 0; i < nextSize_; i++) {
+                slots[i].live = false;
+            }
+            chunks_.push_back(Chunk{slots, nextSize_});
+            bump_ = slots;
+            bumpEnd_ = slots + nextSize_;
+            capacity_ += nextSize_;
+            nextSize_ = nextSize_ * 2 < kMaxChunk ? nextSize_ * 2 : kMaxChunk;
+        }
+        slot = bump_++;
+    }
+
+    Value *p = new (slot->storage) Value(val);
+    slot->live = true;
+    return p;
+}
+
+template <class Value>
+void ValueArena<Value>::deallocate(Value *p)
+{
+    Slot *slot = reinterpret_cast<Slot *>(p);
+    p->~Value();
+    slot->live = false;
+    slot->next = freeList_;
+    freeList_ = slot;
+}
+
+template <class Value>
+void ValueArena<Value>::clear()
+{
+    for (const Chunk &chunk : chunks_) {
+        if (!is_trivially_destructible<Value>::value) {
+            for (size_t i = 0; i < chunk.size; i++) {
+                if (chunk.slots[i].live) {
+                    reinterpret_cast<Value *>(chunk.slots[i].storage)->~Value();
+                }
+            }
+        }
+        ::operator delete(chunk.slots);
+    }
+
+    vector<Chunk>().swap(chunks_);
+    freeList_ = nullptr;
+    bump_ = nullptr;
+    bumpEnd_ = nullptr;
+    nextSize_ = kMinChunk;
+    capacity_ = 0;
+}
+
+template <class Value>
+void ValueArena<Value>::swap(ValueArena &other)
+{
+    chunks_.swap(other.chunks_);
+    std::swap(freeList_, other.freeList_);
+    std::swap(bump_, other.bump_);
+    std::swap(bumpEnd_, other.bumpEnd_);
+    std::swap(nextSize_, other.nextSize_);
+    std::swap(capacity_, other.capacity_);
+}
+
+/**
+ * 结点中值的布局策略，决定值保存在结点内还是ValueArena中
+ * 值很大时放在结点外，下降时访问的结点只有键和链接，一个缓存行能装下更多的键
+ */
+struct InlineValueLayout {
+    template <class Value>
+    static constexpr bool outOfLine() { return false; }
+};
+
+struct OutOfLineValueLayout {
+    template <class Value>
+    static constexpr bool outOfLine() { return true; }
+};
+
+/* sizeof(Value)超过Threshold字节时放在结点外 */
+template <size_t Threshold = 64>
+struct AutoValueLayout {
+    template <class Value>
+    static constexpr bool outOfLine() { return sizeof(Value) > Threshold; }
+};
+
+/**
+ * 结点中的值，结点继承它，两种布局都通过x->value访问
+ * 放在结点外时value是对ValueArena中的值的引用，结点释放时必须调用releaseValue
+ */
+template <class Value, bool OutOfLine>
+struct NodeValue {
+    Value value;
+
+    NodeValue(const Value &val, ValueArena<Value> &) : value(val) {}
+    void releaseValue(ValueArena<Value> &) {}
+};
+
+template <class Value>
+struct NodeValue<Value, true> {
+    Value &value;
+
+    NodeValue(const Value &val, ValueArena<Value> &arena) : value(*arena.allocate(val)) {}
+    void releaseValue(ValueArena<Value> &arena) { arena.deallocate(&value); }
+};
+
+/**
+ * 进程内共享的后台回收线程，树的clear和析构可以把释放结点的工作交给它，调用线程不需要等待
+ * 回收器故意不析构：全局或静态的树可能比它先构造，析构时仍要提交任务；
+ * 进程退出时队列中剩下的任务不再执行，由操作系统回收内存
+ */
+class TreeReclaimer {
+public:
+    static TreeReclaimer &instance() {
+        static TreeReclaimer *reclaimer = new TreeReclaimer;
+        return *reclaimer;
+    }
+
+    void post(function<void()> task);
+
+    /* 等待已经提交的任务全部完成 */
+    void drain();
+
+private:
+    TreeReclaimer() : running_(0) { thread(&TreeReclaimer::run, this).detach(); }
+    ~TreeReclaimer() = delete;
+
+    void run();
+
+private:
+    mutex mutex_;
+    condition_variable cond_;
+    condition_variable idle_;
+    deque<function<void()>> tasks_;
+    int running_;
+};
+
+inline void TreeReclaimer::post(function<void()> task)
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        tasks_.push_back(move(task));
+    }
+    cond_.notify_one();
+}
+
+inline void TreeReclaimer::drain()
+{
+    unique_lock<mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return tasks_.empty() && running_ == 0; });
+}
+
+inline void TreeReclaimer::run()
+{
+    unique_lock<mutex> lock(mutex_);
+    for (;;) {
+        cond_.wait(lock, [this] { return !tasks_.empty(); });
+
+        function<void()> task = move(tasks_.front());
+        tasks_.pop_front();
+        running_++;
+
+        lock.unlock();
+        task();
+        lock.lock();
+
+        running_--;
+        if (tasks_.empty() && running_ == 0) {
+            idle_.notify_all();
+        }
+    }
+}
+
+#endif
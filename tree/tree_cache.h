@@ -0,0 +1,234 @@
+#ifndef __TREE_CACHE_H_
+#define __TREE_CACHE_H_
+
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "tree_filter.h"
+using namespace std;
+
+/**
+ * 直接映射的键->结点缓存，挂在树的get前面
+ * 1. 每个键只可能出现在hash(key)对应的一个槽中，命中只需一次哈希和一次键比较
+ * 2. 冲突时新结点直接覆盖旧结点，不需要维护替换顺序
+ * 3. 槽中保存结点指针，键从结点中读取；结点被删除时必须调用erase，
+ *    旋转和更新值不改变结点地址，不需要处理；shrink()搬动结点时整个缓存被清空
+ * lookup会修改缓存和计数器，挂了缓存的树不能由多个线程同时读
+ */
+template <class Key, class Node>
+class NodeCache {
+public:
+    typedef size_t (*HashFunc)(const Key &);
+
+    NodeCache(int slots, HashFunc hash);
+
+public:
+    Node *lookup(const Key &key);
+    void insert(Node *node) { slots_[slotOf(node->key)] = node; }
+    void erase(const Node *node);
+    void clear();
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+    size_t memoryUsage() const { return sizeof(*this) + slots_.capacity() * sizeof(Node *); }
+
+private:
+    size_t slotOf(const Key &key) const { return static_cast<size_t>(hashMix64(hash_(key))) & mask_; }
+
+private:
+    vector<Node *> slots_;
+    size_t mask_;
+    HashFunc hash_;
+    uint64_t hits_;
+    uint64_t misses_;
+};
+
+template <class Key, class Node>
+NodeCache<Key, Node>::NodeCache(int slots, HashFunc hash)
+{
+    assert(slots > 0);
+
+    size_t n = 1;
+    while (n < static_cast<size_t>(slots)) {
+        n <<= 1;
+    }
+
+    slots_.assign(n, nullptr);
+    mask_ = n - 1;
+    hash_ = hash;
+    hits_ = 0;
+    misses_ = 0;
+}
+
+template <class Key, class Node>
+Node *NodeCache<Key, Node>::lookup(const Key &key)
+{
+    Node *node = slots_[slotOf(key)];
+    if (node != nullptr && node->key == key) {
+        hits_++;
+        return node;
+    }
+
+    misses_++;
+    return nullptr;
+}
+
+template <class Key, class Node>
+void NodeCache<Key, Node>::erase(const Node *node)
+{
+    size_t i = slotOf(node->key);
+    if (slots_[i] == node) {
+        slots_[i] = nullptr;
+    }
+}
+
+template <class Key, class Node>
+void NodeCache<Key, Node>::clear()
+{
+    fill(slots_.begin(), slots_.end(), nullptr);
+}
+
+/**
+ * 开放寻址的键->指针索引，用于在树旁边做O(1)的点查询
+ * 1. 槽中直接保存键和指针，查找只顺序读连续的槽，线性探测
+ * 2. 容量为2的幂，元素超过容量的3/4时翻倍
+ * 3. 删除时把后面同一探测序列上的元素向前移动(backward shift)，不留墓碑，
+ *    删除很多次之后查找也不会变慢
+ * 指针为nullptr表示空槽，因此不能保存空指针
+ */
+template <class Key, class Target>
+class KeyIndex {
+public:
+    typedef size_t (*HashFunc)(const Key &);
+
+    explicit KeyIndex(HashFunc hash);
+
+public:
+    size_t size() const { return count_; }
+
+    Target *find(const Key &key) const;
+
+    /* key已存在时替换指针 */
+    void insert(const Key &key, Target *target);
+    void erase(const Key &key);
+    void clear();
+
+    size_t memoryUsage() const { return sizeof(*this) + slots_.capacity() * sizeof(Slot); }
+
+private:
+    static const size_t kMinCapacity = 16;
+
+    struct Slot {
+        Key key;
+        Target *target;
+    };
+
+    size_t home(const Key &key) const { return static_cast<size_t>(hashMix64(hash_(key))) & mask_; }
+    void grow();
+
+private:
+    vector<Slot> slots_;
+    size_t mask_;
+    size_t count_;
+    HashFunc hash_;
+};
+
+template <class Key, class Target>
+KeyIndex<Key, Target>::KeyIndex(HashFunc hash)
+{
+    slots_.assign(kMinCapacity, Slot{Key(), nullptr});
+    mask_ = kMinCapacity - 1;
+    count_ = 0;
+    hash_ = hash;
+}
+
+template <class Key, class Target>
+Target *KeyIndex<Key, Target>::find(const Key &key) const
+{
+    for (size_t i = home(key); ; i = (i + 1) & mask_) {
+        const Slot &slot = slots_[i];
+        if (slot.target == nullptr) {
+            return nullptr;
+        }
+        if (slot.key == key) {
+            return slot.target;
+        }
+    }
+}
+
+template <class Key, class Target>
+void KeyIndex<Key, Target>::insert(const Key &key, Target *target)
+{
+    assert(target != nullptr);
+
+    if ((count_ + 1) * 4 > slots_.size() * 3) {
+        grow();
+    }
+
+    for (size_t i = home(key); ; i = (i + 1) & mask_) {
+        Slot &slot = slots_[i];
+        if (slot.target == nullptr) {
+            slot.key = key;
+            slot.target = target;
+            count_++;
+            return;
+        }
+        if (slot.key == key) {
+            slot.target = target;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief 删除后向后扫描同一簇中的元素，探测起点不在(空洞, 当前位置]之间的元素移到空洞上
+ */
+template <class Key, class Target>
+void KeyIndex<Key, Target>::erase(const Key &key)
+{
+    size_t hole = home(key);
+    for (; ; hole = (hole + 1) & mask_) {
+        if (slots_[hole].target == nullptr) {
+            return;
+        }
+        if (slots_[hole].key == key) {
+            break;
+        }
+    }
+
+    count_--;
+    for (size_t i = (hole + 1) & mask_; slots_[i].target != nullptr; i = (i + 1) & mask_) {
+        size_t h = home(slots_[i].key);
+        if (((i - h) & mask_) >= ((i - hole) & mask_)) {
+            slots_[hole] = slots_[i];
+            hole = i;
+        }
+    }
+    slots_[hole] = Slot{Key(), nullptr};
+}
+
+template <class Key, class Target>
+void KeyIndex<Key, Target>::clear()
+{
+    vector<Slot>(kMinCapacity, Slot{Key(), nullptr}).swap(slots_);
+    mask_ = kMinCapacity - 1;
+    count_ = 0;
+}
+
+template <class Key, class Target>
+void KeyIndex<Key, Target>::grow()
+{
+    vector<Slot> old(slots_.size() * 2, Slot{Key(), nullptr});
+    old.swap(slots_);
+    mask_ = slots_.size() - 1;
+    count_ = 0;
+
+    for (const Slot &slot : old) {
+        if (slot.target != nullptr) {
+            insert(slot.key, slot.target);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef __TREE_FILTER_H_
+#define __TREE_FILTER_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+using namespace std;
+
+/**
+ * @brief 64位哈希的最终混合(murmur3 fmix64)，std::hash对整数往往是恒等映射
+ */
+inline uint64_t hashMix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * 计数布隆过滤器，挂在树的前面过滤不存在的键
+ * 1. 每个位置是4位的计数器而不是1位，删除键时计数器减1，因此支持deleteKey
+ *    计数器达到15后不再变化，避免溢出后产生假阴性
+ * 2. 分块：一个键的k个计数器都落在同一个64字节的块中，一次查询最多访问一个缓存行
+ * 3. mayContain返回false时键一定不存在；返回true时键可能存在，误判率约为fpRate
+ * 哈希函数以函数指针的形式传入，不要求树的每种键类型都能哈希
+ */
+template <class Key>
+class CountingBloomFilter {
+public:
+    typedef size_t (*HashFunc)(const Key &);
+
+    CountingBloomFilter(size_t expectedKeys, double fpRate, HashFunc hash);
+
+public:
+    void add(const Key &key);
+    void remove(const Key &key);
+    bool mayContain(const Key &key) const;
+    void clear();
+
+    size_t capacity() const { return expected_; }
+    double fpRate() const { return fpRate_; }
+    HashFunc hashFunc() const { return hash_; }
+    size_t memoryUsage() const { return sizeof(*this) + words_.capacity() * sizeof(uint64_t); }
+
+    /* 用Hash类型的函数对象计算哈希，用于构造HashFunc */
+    template <class Hash>
+    static size_t hashWith(const Key &key) { return Hash()(key); }
+
+private:
+    static const int kCountersPerBlock = 128;   // 64字节，每个计数器4位
+    static const int kWordsPerBlock = 8;
+
+    /* 对键的k个计数器依次调用fn(word, shift) */
+    template <class Func>
+    void probe(const Key &key, Func fn) const;
+
+private:
+    vector<uint64_t> words_;
+    size_t blocks_;
+    int k_;
+    size_t expected_;
+    double fpRate_;
+    HashFunc hash_;
+};
+
+template <class Key>
+CountingBloomFilter<Key>::CountingBloomFilter(size_t expectedKeys, double fpRate, HashFunc hash)
+{
+    assert(fpRate > 0 && fpRate < 1);
+
+    expected_ = expectedKeys > 0 ? expectedKeys : 1;
+    fpRate_ = fpRate;
+    hash_ = hash;
+
+    // m = -n * ln(p) / ln(2)^2, k = m / n * ln(2)
+    // 分块后各块的负载不均匀，计数器多分配1/4来抵消误判率的上升
+    double perKey = -log(fpRate) / (log(2.0) * log(2.0));
+    size_t counters = static_cast<size_t>(ceil(perKey * 1.25 * expected_));
+
+    blocks_ = (counters + kCountersPerBlock - 1) / kCountersPerBlock;
+    k_ = max(1, static_cast<int>(perKey * log(2.0) + 0.5));
+    words_.assign(blocks_ * kWordsPerBlock, 0);
+}
+
+/**
+ * 高32位选择块，块内的每个位置取另一个混合哈希中的7位，用完9个位置后重新混合
+ */
+template <class Key>
+template <class Func>
+void CountingBloomFilter<Key>::probe(const Key &key, Func fn) const
+{
+    uint64_t h = hashMix64(hash_(key));
+    size_t block = static_cast<size_t>(((h >> 32) * blocks_) >> 32);
+    const size_t base = block * kWordsPerBlock;
+
+    uint64_t bits = hashMix64(h + 0x9e3779b97f4a7c15ULL);
+    for (int i = 0; i < k_; i++) {
+        if (i != 0 && i % 9 == 0) {
+            bits = hashMix64(bits + h);
+        }
+
+        unsigned pos = static_cast<unsigned>(bits) & (kCountersPerBlock - 1);
+        fn(base + pos / 16, (pos % 16) * 4);
+        bits >>= 7;
+    }
+}
+
+template <class Key>
+void CountingBloomFilter<Key>::add(const Key &key)
+{
+    probe(key, [this](size_t word, unsigned shift) {
+        if (((words_[word] >> shift) & 0xf) != 0xf) {
+            words_[word] += uint64_t(1) << shift;
+        }
+    });
+}
+
+template <class Key>
+void CountingBloomFilter<Key>::remove(const Key &key)
+{
+    probe(key, [this](size_t word, unsigned shift) {
+        uint64_t c = (words_[word] >> shift) & 0xf;
+        if (c != 0 && c != 0xf) {
+            words_[word] -= uint64_t(1) << shift;
+        }
+    });
+}
+
+template <class Key>
+bool CountingBloomFilter<Key>::mayContain(const Key &key) const
+{
+    bool found = true;
+    probe(key, [this, &found](size_t word, unsigned shift) {
+        if (((words_[word] >> shift) & 0xf) == 0) {
+            found = false;
+        }
+    });
+    return found;
+}
+
+template <class Key>
+void CountingBloomFilter<Key>::clear()
+{
+    fill(words_.begin(), words_.end(), 0);
+}
+
+#endif
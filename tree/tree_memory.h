@@ -0,0 +1,87 @@
+#ifndef __TREE_MEMORY_H_
+#define __TREE_MEMORY_H_
+
+#include <cstddef>
+#include <functional>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+using namespace std;
+
+/**
+ * 树占用的内存
+ * nodeBytes: 结点本身的大小之和
+ * allocatorOverhead: 分配器为每个结点额外占用的字节(块头、对齐)
+ * auxiliaryBytes: 树对象本身以及过滤器、缓存等附加结构
+ * 键、值内部另外分配的内存(如string的堆缓冲区)不计算在内
+ */
+struct TreeMemoryUsage {
+    size_t entries;
+    size_t nodeBytes;
+    size_t allocatorOverhead;
+    size_t auxiliaryBytes;
+
+    size_t totalBytes() const { return nodeBytes + allocatorOverhead + auxiliaryBytes; }
+    double bytesPerEntry() const { return entries != 0 ? static_cast<double>(totalBytes()) / entries : 0.0; }
+};
+
+/**
+ * @brief 估算分配n字节时分配器实际占用的块大小
+ * glibc: 块头8字节，按16字节对齐，最小32字节；其它分配器按16字节对齐估算
+ */
+inline size_t allocatedSize(size_t n)
+{
+#if defined(__GLIBC__)
+    size_t chunk = (n + sizeof(size_t) + 15) & ~static_cast<size_t>(15);
+    return chunk < 32 ? 32 : chunk;
+#else
+    return (n + 15) & ~static_cast<size_t>(15);
+#endif
+}
+
+/**
+ * @brief 把分配器中空闲的内存还给操作系统，作用于整个进程
+ */
+inline void trimHeap()
+{
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
+
+/**
+ * 内存预算：占用从预算之内变为超出预算时调用一次回调，回到预算之内后重新计数
+ */
+class TreeMemoryBudget {
+public:
+    using Callback = function<void(const TreeMemoryUsage &)>;
+
+    TreeMemoryBudget() : limit_(0), over_(false) {}
+
+    void set(size_t limit, Callback onExceeded) {
+        limit_ = limit;
+        onExceeded_ = onExceeded;
+        over_ = false;
+    }
+    void clear() { set(0, Callback()); }
+
+    bool enabled() const { return limit_ != 0; }
+
+    void check(const TreeMemoryUsage &usage) {
+        bool over = usage.totalBytes() > limit_;
+        if (over && !over_ && onExceeded_) {
+            over_ = true;
+            onExceeded_(usage);
+        }
+        if (!over) {
+            over_ = false;
+        }
+    }
+
+private:
+    size_t limit_;
+    bool over_;
+    Callback onExceeded_;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef __TREE_PARALLEL_H_
+#define __TREE_PARALLEL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/**
+ * 工作窃取线程池，用于按子树拆分的并行遍历
+ * 1. 每个工作线程有自己的任务队列，从队尾取自己提交的任务(后进先出，子树的数据仍在缓存中)，
+ *    自己的队列空了再从其它队列的队头窃取(先进先出，窃取到的是较大的子树)
+ * 2. 池外线程提交的任务放在单独的一个队列中
+ * 3. 等待任务完成的线程通过runOne继续执行任务，嵌套的fork-join不会因为线程都在等待而死锁
+ */
+class WorkStealingPool {
+public:
+    /* 进程内共享的线程池，线程数为硬件线程数 */
+    static WorkStealingPool &instance() {
+        static WorkStealingPool pool(thread::hardware_concurrency());
+        return pool;
+    }
+
+    explicit WorkStealingPool(unsigned threads);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+public:
+    int threadCount() { return static_cast<int>(workers_.size()); }
+
+    void submit(function<void()> task);
+
+    /* 取一个任务在当前线程执行，没有任务时返回false */
+    bool runOne();
+
+private:
+    struct Queue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    /* 当前线程在哪个池中的哪个队列，池外线程为-1 */
+    struct Worker {
+        WorkStealingPool *pool;
+        int index;
+    };
+    static Worker &currentWorker() {
+        thread_local Worker worker = {nullptr, -1};
+        return worker;
+    }
+    int currentIndex() { return currentWorker().pool == this ? currentWorker().index : -1; }
+
+    bool take(function<void()> &task);
+    void run(int index);
+
+private:
+    vector<unique_ptr<Queue>> queues_;  // 前threadCount()个属于工作线程，最后一个属于池外线程
+    vector<thread> workers_;
+    atomic<int> queued_;
+    bool stop_;
+    mutex sleepLock_;
+    condition_variable wake_;
+};
+
+inline WorkStealingPool::WorkStealingPool(unsigned threads) : queued_(0), stop_(false)
+{
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    for (unsigned i = 0; i <= threads; i++) {
+        queues_.emplace_back(new Queue());
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers_.emplace_back(&WorkStealingPool::run, this, static_cast<int>(i));
+    }
+}
+
+inline WorkStealingPool::~WorkStealingPool()
+{
+    {
+        lock_guard<mutex> guard(sleepLock_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (thread &worker : workers_) {
+        worker.join();
+    }
+}
+
+inline void WorkStealingPool::submit(function<void()> task)
+{
+    int index = currentIndex();
+    Queue &queue = *queues_[index >= 0 ? index : queues_.size() - 1];
+    {
+        lock_guard<mutex> guard(queue.lock);
+        queue.tasks.push_back(move(task));
+    }
+
+    queued_.fetch_add(1, memory_order_release);
+    {
+        lock_guard<mutex> guard(sleepLock_);
+    }
+    wake_.notify_one();
+}
+
+/**
+ * @brief 先从自己的队尾取，再依次从其它队列的队头窃取
+ */
+inline bool WorkStealingPool::take(function<void()> &task)
+{
+    if (queued_.load(memory_order_acquire) == 0) {
+        return false;
+    }
+
+    int self = currentIndex();
+    int count = static_cast<int>(queues_.size());
+    if (self >= 0) {
+        Queue &queue = *queues_[self];
+        lock_guard<mutex> guard(queue.lock);
+        if (!queue.tasks.empty()) {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+            queued_.fetch_sub(1, memory_order_relaxed);
+            return true;
+        }
+    }
+
+    int start = self >= 0 ? self + 1 : 0;
+    for (int i = 0; i < count; i++) {
+        int victim = (start + i) % count;
+        if (victim == self) {
+            continue;
+        }
+
+        Queue &queue = *queues_[victim];
+        lock_guard<mutex> guard(queue.lock);
+        if (!queue.tasks.empty()) {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+            queued_.fetch_sub(1, memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline bool WorkStealingPool::runOne()
+{
+    function<void()> task;
+    if (!take(task)) {
+        return false;
+    }
+
+    task();
+    return true;
+}
+
+inline void WorkStealingPool::run(int index)
+{
+    currentWorker() = Worker{this, index};
+
+    for (;;) {
+        if (runOne()) {
+            continue;
+        }
+
+        unique_lock<mutex> lock(sleepLock_);
+        wake_.wait(lock, [this] { return stop_ || queued_.load(memory_order_acquire) > 0; });
+        if (stop_) {
+            return;
+        }
+    }
+}
+
+/**
+ * 一组fork-join任务：run提交任务，wait等待这一组任务全部完成，等待期间帮助执行池中的任务
+ */
+class TaskGroup {
+public:
+    explicit TaskGroup(WorkStealingPool &pool) : pool_(pool), pending_(0) {}
+    ~TaskGroup() { wait(); }
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+public:
+    template <class Func>
+    void run(Func fn) {
+        pending_.fetch_add(1, memory_order_relaxed);
+        pool_.submit([this, fn] {
+            fn();
+            pending_.fetch_sub(1, memory_order_release);
+        });
+    }
+
+    void wait() {
+        while (pending_.load(memory_order_acquire) != 0) {
+            if (!pool_.runOne()) {
+                this_thread::yield();
+            }
+        }
+    }
+
+private:
+    WorkStealingPool &pool_;
+    atomic<int> pending_;
+};
+
+#endif